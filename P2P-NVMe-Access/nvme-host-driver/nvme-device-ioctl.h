@@ -13,7 +13,7 @@ typedef uint64_t u64;
 
 // ioctl constants
 #define NVME_IOCTL_MAGIC 74
-#define NVME_IOCTL_MAX   4
+#define NVME_IOCTL_MAX   8
 
 // ioctl commands
 #define NVME_GET_PCIE_BASE    _IOR(NVME_IOCTL_MAGIC, 0x0, unsigned long)
@@ -21,6 +21,10 @@ typedef uint64_t u64;
 #define NVME_RELEASE_IO_QUEUE _IOWR(NVME_IOCTL_MAGIC, 0x2, unsigned long)
 #define NVME_WRITE            _IOWR(NVME_IOCTL_MAGIC, 0x3, unsigned long)
 #define NVME_READ             _IOWR(NVME_IOCTL_MAGIC, 0x4, unsigned long)
+#define NVME_SET_EVENTFD      _IOW(NVME_IOCTL_MAGIC, 0x5, unsigned long)
+#define NVME_WRITE_ASYNC      _IOWR(NVME_IOCTL_MAGIC, 0x6, unsigned long)
+#define NVME_READ_ASYNC       _IOWR(NVME_IOCTL_MAGIC, 0x7, unsigned long)
+#define NVME_HARVEST          _IOWR(NVME_IOCTL_MAGIC, 0x8, unsigned long)
 
 enum {
         CREATE_IO_QUEUE_PRESENT,
@@ -51,4 +55,29 @@ struct ioctl_nvme_cmd {
         u64 status;
 };
 
+// eventfd signaled once per completed asynchronous command (fd < 0 unregisters)
+struct ioctl_set_eventfd_cmd {
+        int fd;
+};
+
+// asynchronous read/write, returns handle identifying the command on completion
+struct ioctl_nvme_async_cmd {
+        u64 nvme_addr;
+        u64 len;
+        void *buf;
+        u64 handle;
+};
+
+struct ioctl_nvme_completion {
+        u64 handle;
+        u64 status;
+};
+
+// harvest up to max_entries completions into user-space array entries
+struct ioctl_nvme_harvest_cmd {
+        struct ioctl_nvme_completion *entries;
+        u64 max_entries;
+        u64 nr_entries;
+};
+
 #endif //NVME_HOST_DRIVER_NVME_DEVICE_IOCTL_H
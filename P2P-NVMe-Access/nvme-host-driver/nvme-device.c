@@ -16,12 +16,23 @@
 #include <linux/device.h>
 #include <linux/delay.h>
 #include <linux/version.h>
+#include <linux/eventfd.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/sched/mm.h>
+#include <linux/kref.h>
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+#include <linux/mmu_context.h>
+#endif
 
 #include "nvme-device-ioctl.h"
 
 #define DEVICE_NAME "nvme-host-driver"
 #define CLASS_NAME "nvme-host-class"
 
+// asynchronous commands per open file that are queued or completed but not yet harvested
+#define NVME_ASYNC_MAX_REQS 256
+
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Torben Kalkhof");
 
@@ -293,6 +304,32 @@ struct nvme_driver_data {
         struct nvme_queue *admin_queue;
         struct nvme_queue *io_queue;
         struct nvme_queue *fpga_queue;
+        struct mutex io_lock;               ///< serializes access to host IO queue
+        struct workqueue_struct *async_wq;  ///< executes asynchronous commands in order
+        struct kref ref;                    ///< held by the PCIe device and each open file
+        bool removed;                       ///< PCIe device removed, protected by io_lock
+};
+
+/// Per-open context of the device file
+struct nvme_file_ctx {
+        struct nvme_driver_data *nvme_data;
+        struct eventfd_ctx      *eventfd;   ///< signaled on completion of async command
+        spinlock_t              lock;       ///< protects eventfd, lists and request count
+        struct list_head        queued;     ///< async commands not yet completed
+        struct list_head        done;       ///< completed async commands not yet harvested
+        unsigned int            nr_reqs;    ///< commands in both lists
+        u64                     next_handle;
+};
+
+/// Asynchronous read/write command
+struct nvme_async_req {
+        struct work_struct      work;
+        struct list_head        list;
+        struct nvme_file_ctx    *ctx;
+        struct mm_struct        *mm;        ///< address space of submitting process
+        bool                    write;
+        u64                     handle;
+        struct ioctl_nvme_cmd   cmd;
 };
 
 static int nvme_open(struct inode *inode, struct file *file);
@@ -311,22 +348,81 @@ static struct file_operations nvme_fops = {
         .unlocked_ioctl = nvme_ioctl,
 };
 
+/**
+ * Free driver data after PCIe device and all open files have released it
+ *
+ * @param ref reference counter embedded in driver data
+ */
+static void nvme_free_data(struct kref *ref)
+{
+        struct nvme_driver_data *nvme_data = container_of(ref, struct nvme_driver_data, ref);
+
+        destroy_workqueue(nvme_data->async_wq);
+        pci_dev_put(nvme_data->pdev);
+        kfree(nvme_data);
+}
+
 static int nvme_open(struct inode *inode, struct file *file)
 {
         struct nvme_driver_data *nvme_data;
+        struct nvme_file_ctx *ctx;
 
         nvme_data = container_of(inode->i_cdev, struct nvme_driver_data, cdev);
         dev_info(&nvme_data->pdev->dev, "Opening device file...\n");
 
-        file->private_data = nvme_data;
+        ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+        if (!ctx) {
+                dev_err(&nvme_data->pdev->dev, "Failed to allocate file context\n");
+                return -ENOMEM;
+        }
+        ctx->nvme_data = nvme_data;
+        spin_lock_init(&ctx->lock);
+        INIT_LIST_HEAD(&ctx->queued);
+        INIT_LIST_HEAD(&ctx->done);
+        ctx->next_handle = 1;
+
+        // driver data and workqueue are kept until the file is closed, even if the device is removed before
+        kref_get(&nvme_data->ref);
+        file->private_data = ctx;
         return 0;
 }
 
 static int nvme_release(struct inode *inode, struct file *file)
 {
         struct nvme_driver_data *nvme_data;
+        struct nvme_file_ctx *ctx = file->private_data;
+        struct nvme_async_req *req, *tmp;
+        unsigned long flags;
+
         nvme_data = container_of(inode->i_cdev, struct nvme_driver_data, cdev);
         dev_info(&nvme_data->pdev->dev, "Closing device file...\n");
+
+        // cancel async commands of this file that have not started, wait for a running one
+        for (;;) {
+                spin_lock_irqsave(&ctx->lock, flags);
+                req = list_first_entry_or_null(&ctx->queued, struct nvme_async_req, list);
+                spin_unlock_irqrestore(&ctx->lock, flags);
+                if (!req)
+                        break;
+                if (cancel_work_sync(&req->work)) {
+                        spin_lock_irqsave(&ctx->lock, flags);
+                        list_del(&req->list);
+                        spin_unlock_irqrestore(&ctx->lock, flags);
+                        mmput(req->mm);
+                        kfree(req);
+                }
+                // otherwise the command has completed and was moved to the done list
+        }
+
+        // drop completions not harvested
+        list_for_each_entry_safe(req, tmp, &ctx->done, list) {
+                list_del(&req->list);
+                kfree(req);
+        }
+        if (ctx->eventfd)
+                eventfd_ctx_put(ctx->eventfd);
+        kfree(ctx);
+        kref_put(&nvme_data->ref, nvme_free_data);
         return 0;
 }
 
@@ -494,18 +590,200 @@ fail_prp:
         cmd->status = res;
 }
 
+/**
+ * Execute asynchronous command in the address space of the submitting process
+ * and signal its completion
+ *
+ * @param work work struct embedded in async request
+ */
+static void nvme_async_work(struct work_struct *work)
+{
+        struct nvme_async_req *req = container_of(work, struct nvme_async_req, work);
+        struct nvme_file_ctx *ctx = req->ctx;
+        struct nvme_driver_data *nvme_data = ctx->nvme_data;
+        unsigned long flags;
+
+        // user buffer is accessed from worker thread
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+        use_mm(req->mm);
+#else
+        kthread_use_mm(req->mm);
+#endif
+        mutex_lock(&nvme_data->io_lock);
+        if (nvme_data->removed)
+                req->cmd.status = -ENODEV;
+        else if (req->write)
+                write_to_nvme(nvme_data->pdev, nvme_data, &req->cmd);
+        else
+                read_from_nvme(nvme_data->pdev, nvme_data, &req->cmd);
+        mutex_unlock(&nvme_data->io_lock);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+        unuse_mm(req->mm);
+#else
+        kthread_unuse_mm(req->mm);
+#endif
+        mmput(req->mm);
+
+        spin_lock_irqsave(&ctx->lock, flags);
+        list_move_tail(&req->list, &ctx->done);
+        if (ctx->eventfd) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 8, 0)
+                eventfd_signal(ctx->eventfd, 1);
+#else
+                eventfd_signal(ctx->eventfd);
+#endif
+        }
+        spin_unlock_irqrestore(&ctx->lock, flags);
+}
+
+/**
+ * Queue asynchronous read/write command for execution
+ *
+ * @param ctx file context of submitting process
+ * @param async_cmd IOCTL command, handle is returned in this struct
+ * @param user_cmd IOCTL argument in user space, handle is copied back before the command is queued
+ * @param write true for write to NVMe, false for read
+ * @return 0 - SUCCESS, error code - FAILURE
+ */
+static int submit_async_cmd(struct nvme_file_ctx *ctx, struct ioctl_nvme_async_cmd *async_cmd,
+                struct ioctl_nvme_async_cmd __user *user_cmd, bool write)
+{
+        struct nvme_async_req *req;
+        unsigned long flags;
+
+        req = kzalloc(sizeof(*req), GFP_KERNEL);
+        if (!req)
+                return -ENOMEM;
+        req->mm = get_task_mm(current);
+        if (!req->mm) {
+                kfree(req);
+                return -EFAULT;
+        }
+        req->ctx = ctx;
+        req->write = write;
+        req->cmd.nvme_addr = async_cmd->nvme_addr;
+        req->cmd.len = async_cmd->len;
+        req->cmd.buf = async_cmd->buf;
+        INIT_WORK(&req->work, nvme_async_work);
+
+        spin_lock_irqsave(&ctx->lock, flags);
+        if (ctx->nr_reqs >= NVME_ASYNC_MAX_REQS) {
+                spin_unlock_irqrestore(&ctx->lock, flags);
+                mmput(req->mm);
+                kfree(req);
+                return -EBUSY;
+        }
+        ++ctx->nr_reqs;
+        req->handle = ctx->next_handle++;
+        spin_unlock_irqrestore(&ctx->lock, flags);
+        async_cmd->handle = req->handle;
+
+        // a command whose handle cannot be returned is not executed
+        if (copy_to_user(user_cmd, async_cmd, sizeof(*async_cmd))) {
+                spin_lock_irqsave(&ctx->lock, flags);
+                --ctx->nr_reqs;
+                spin_unlock_irqrestore(&ctx->lock, flags);
+                mmput(req->mm);
+                kfree(req);
+                return -EFAULT;
+        }
+
+        spin_lock_irqsave(&ctx->lock, flags);
+        list_add_tail(&req->list, &ctx->queued);
+        spin_unlock_irqrestore(&ctx->lock, flags);
+        queue_work(ctx->nvme_data->async_wq, &req->work);
+        return 0;
+}
+
+/**
+ * Return completed asynchronous commands to user space
+ *
+ * @param ctx file context of calling process
+ * @param harvest_cmd IOCTL command, number of returned entries is set in this struct
+ * @return 0 - SUCCESS, error code - FAILURE
+ */
+static int harvest_async_cmds(struct nvme_file_ctx *ctx, struct ioctl_nvme_harvest_cmd *harvest_cmd)
+{
+        struct nvme_async_req *req;
+        struct ioctl_nvme_completion c;
+        unsigned long flags;
+        u64 n = 0;
+
+        while (n < harvest_cmd->max_entries) {
+                spin_lock_irqsave(&ctx->lock, flags);
+                req = list_first_entry_or_null(&ctx->done, struct nvme_async_req, list);
+                if (req)
+                        list_del(&req->list);
+                spin_unlock_irqrestore(&ctx->lock, flags);
+                if (!req)
+                        break;
+
+                c.handle = req->handle;
+                c.status = req->cmd.status;
+                if (copy_to_user((void __user *)&harvest_cmd->entries[n], &c, sizeof(c))) {
+                        // put back completion to not lose it
+                        spin_lock_irqsave(&ctx->lock, flags);
+                        list_add(&req->list, &ctx->done);
+                        spin_unlock_irqrestore(&ctx->lock, flags);
+                        harvest_cmd->nr_entries = n;
+                        return -EFAULT;
+                }
+                spin_lock_irqsave(&ctx->lock, flags);
+                --ctx->nr_reqs;
+                spin_unlock_irqrestore(&ctx->lock, flags);
+                kfree(req);
+                ++n;
+        }
+        harvest_cmd->nr_entries = n;
+        return 0;
+}
+
+/**
+ * Register eventfd for completion notification of asynchronous commands
+ *
+ * @param ctx file context of calling process
+ * @param fd eventfd file descriptor, negative value unregisters current eventfd
+ * @return 0 - SUCCESS, error code - FAILURE
+ */
+static int set_eventfd(struct nvme_file_ctx *ctx, int fd)
+{
+        struct eventfd_ctx *new_eventfd = NULL, *old_eventfd;
+        unsigned long flags;
+
+        if (fd >= 0) {
+                new_eventfd = eventfd_ctx_fdget(fd);
+                if (IS_ERR(new_eventfd))
+                        return PTR_ERR(new_eventfd);
+        }
+        spin_lock_irqsave(&ctx->lock, flags);
+        old_eventfd = ctx->eventfd;
+        ctx->eventfd = new_eventfd;
+        spin_unlock_irqrestore(&ctx->lock, flags);
+        if (old_eventfd)
+                eventfd_ctx_put(old_eventfd);
+        return 0;
+}
+
 static long nvme_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
         int res;
         struct ioctl_setup_io_queue_cmd setup_cmd;
         struct ioctl_release_io_queue_cmd release_cmd;
         struct ioctl_nvme_cmd nvme_cmd;
-        struct nvme_driver_data *nvme_data = file->private_data;
+        struct ioctl_set_eventfd_cmd eventfd_cmd;
+        struct ioctl_nvme_async_cmd async_cmd;
+        struct ioctl_nvme_harvest_cmd harvest_cmd;
+        struct nvme_file_ctx *ctx = file->private_data;
+        struct nvme_driver_data *nvme_data = ctx->nvme_data;
         struct pci_dev *pdev = nvme_data->pdev;
 
         if (_IOC_TYPE(cmd) != NVME_IOCTL_MAGIC || _IOC_NR(cmd) > NVME_IOCTL_MAX) {
                 dev_err(&pdev->dev, "Invalid ioctl command\n");
                 return -ENOTTY;
         }
+        // queue setup, release and submission need the device, transfers check again under io_lock.
+        // Completions and the eventfd stay available, so commands completed with -ENODEV can be harvested.
+        if (READ_ONCE(nvme_data->removed) && cmd != NVME_HARVEST && cmd != NVME_SET_EVENTFD)
+                return -ENODEV;
 
         switch (cmd) {
                 case NVME_GET_PCIE_BASE:
@@ -559,7 +837,12 @@ static long nvme_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
                                 dev_err(&pdev->dev, "Failed to copy ioctl args to kernel space\n");
                                 return -EAGAIN;
                         }
-                        write_to_nvme(pdev, nvme_data, &nvme_cmd);
+                        mutex_lock(&nvme_data->io_lock);
+                        if (nvme_data->removed)
+                                nvme_cmd.status = -ENODEV;
+                        else
+                                write_to_nvme(pdev, nvme_data, &nvme_cmd);
+                        mutex_unlock(&nvme_data->io_lock);
                         res = copy_to_user((unsigned long __user *)arg, &nvme_cmd, sizeof(struct ioctl_nvme_cmd));
                         if (res) {
                                 dev_err(&pdev->dev, "Failed to copy ioctl result to user space\n");
@@ -571,12 +854,56 @@ static long nvme_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
                                 dev_err(&pdev->dev, "Failed to copy ioctl args to kernel space\n");
                                 return -EAGAIN;
                         }
-                        read_from_nvme(pdev, nvme_data, &nvme_cmd);
+                        mutex_lock(&nvme_data->io_lock);
+                        if (nvme_data->removed)
+                                nvme_cmd.status = -ENODEV;
+                        else
+                                read_from_nvme(pdev, nvme_data, &nvme_cmd);
+                        mutex_unlock(&nvme_data->io_lock);
                         res = copy_to_user((unsigned long __user *)arg, &nvme_cmd, sizeof(struct ioctl_nvme_cmd));
                         if (res) {
                                 dev_err(&pdev->dev, "Failed to copy ioctl result to user space\n");
                         }
                         break;
+                case NVME_SET_EVENTFD:
+                        res = copy_from_user(&eventfd_cmd, (void __user *)arg, sizeof(struct ioctl_set_eventfd_cmd));
+                        if (res) {
+                                dev_err(&pdev->dev, "Failed to copy ioctl args to kernel space\n");
+                                return -EAGAIN;
+                        }
+                        res = set_eventfd(ctx, eventfd_cmd.fd);
+                        if (res) {
+                                dev_err(&pdev->dev, "Failed to register eventfd\n");
+                                return res;
+                        }
+                        break;
+                case NVME_WRITE_ASYNC:
+                case NVME_READ_ASYNC:
+                        res = copy_from_user(&async_cmd, (void __user *)arg, sizeof(struct ioctl_nvme_async_cmd));
+                        if (res) {
+                                dev_err(&pdev->dev, "Failed to copy ioctl args to kernel space\n");
+                                return -EAGAIN;
+                        }
+                        res = submit_async_cmd(ctx, &async_cmd, (void __user *)arg, cmd == NVME_WRITE_ASYNC);
+                        if (res) {
+                                dev_err(&pdev->dev, "Failed to submit asynchronous command\n");
+                                return res;
+                        }
+                        break;
+                case NVME_HARVEST:
+                        res = copy_from_user(&harvest_cmd, (void __user *)arg, sizeof(struct ioctl_nvme_harvest_cmd));
+                        if (res) {
+                                dev_err(&pdev->dev, "Failed to copy ioctl args to kernel space\n");
+                                return -EAGAIN;
+                        }
+                        res = harvest_async_cmds(ctx, &harvest_cmd);
+                        if (copy_to_user((void __user *)arg, &harvest_cmd, sizeof(struct ioctl_nvme_harvest_cmd))) {
+                                dev_err(&pdev->dev, "Failed to copy ioctl result to user space\n");
+                                return -EAGAIN;
+                        }
+                        if (res)
+                                return res;
+                        break;
         }
         return 0;
 }
@@ -1052,15 +1379,25 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
         int res;
         struct nvme_driver_data *nvme_data;
 
-        // allocate device struct
-        nvme_data = devm_kzalloc(&pdev->dev, sizeof(*nvme_data), GFP_KERNEL);
+        // allocate device struct, not device managed as open files may outlive the device (see nvme_free_data)
+        nvme_data = kzalloc(sizeof(*nvme_data), GFP_KERNEL);
         if (!nvme_data) {
                 dev_err(&pdev->dev, "Failed to allocate device data structure\n");
                 res = -ENOMEM;
                 goto fail_alloc;
         }
         dev_set_drvdata(&pdev->dev, nvme_data);
-        nvme_data->pdev = pdev;
+        nvme_data->pdev = pci_dev_get(pdev);
+        mutex_init(&nvme_data->io_lock);
+        kref_init(&nvme_data->ref);
+
+        // ordered workqueue, host IO queue handles one command at a time
+        nvme_data->async_wq = alloc_ordered_workqueue("%s", 0, DEVICE_NAME);
+        if (!nvme_data->async_wq) {
+                dev_err(&pdev->dev, "Failed to allocate workqueue\n");
+                res = -ENOMEM;
+                goto fail_wq;
+        }
 
         res = pci_enable_device(pdev);
         if (res) {
@@ -1121,7 +1458,10 @@ fail_region:
         pci_disable_device(pdev);
 
 fail_enable:
-        devm_kfree(&pdev->dev, nvme_data);
+        destroy_workqueue(nvme_data->async_wq);
+fail_wq:
+        pci_dev_put(pdev);
+        kfree(nvme_data);
 fail_alloc:
         return res;
 }
@@ -1130,6 +1470,11 @@ static void nvme_remove(struct pci_dev *pdev)
 {
         struct nvme_driver_data *nvme_data = dev_get_drvdata(&pdev->dev);
 
+        // commands of files still open complete with -ENODEV from now on
+        mutex_lock(&nvme_data->io_lock);
+        nvme_data->removed = true;
+        mutex_unlock(&nvme_data->io_lock);
+
         // silently fails if FPGA queue not setup
         release_fpga_io_queue(pdev, nvme_data);
         release_host_io_queue(pdev, nvme_data);
@@ -1139,7 +1484,7 @@ static void nvme_remove(struct pci_dev *pdev)
         pci_release_regions(pdev);
         pci_clear_master(pdev);
         pci_disable_device(pdev);
-        devm_kfree(&pdev->dev, nvme_data);
+        kref_put(&nvme_data->ref, nvme_free_data);
 }
 
 static struct pci_device_id nvme_ids[] = {
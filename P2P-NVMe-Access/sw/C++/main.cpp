@@ -2,6 +2,11 @@
  * Copyright (c) 2025-2026 Embedded Systems and Applications Group, TU Darmstadt
  */
 #include <iostream>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <thread>
 #include <boost/program_options.hpp>
 
 #include <fcntl.h>
@@ -20,7 +25,7 @@ namespace po = boost::program_options;
  */
 struct Command {
     uint64_t rw;
-    uint64_t nr_pages;
+    uint64_t nr_blocks;
     uint64_t nvme_addr;
     uint64_t fpga_addr;
 };
@@ -30,6 +35,69 @@ enum Direction {
     WRITE = 1
 };
 
+/**
+ * Control block of command ring in on-board DRAM (one 64-byte line polled by IP)
+ */
+struct RingControl {
+    uint64_t tail;      // written by host: total number of commands enqueued
+    uint64_t stop;      // written by host: stop IP after all enqueued commands completed
+    uint64_t head;      // written by IP: total number of commands fetched from ring
+    uint64_t completed; // written by IP: total number of commands completed
+    uint64_t reserved[4];
+};
+
+/**
+ * Command ring in on-board DRAM for continuous operation of the IP without relaunch
+ */
+struct CommandRing {
+    tapasco::DeviceAddress ring_addr;
+    tapasco::DeviceAddress ctrl_addr;
+    uint64_t size;
+    uint64_t tail;
+};
+
+#define RING_SIZE 64
+
+/**
+ * Completion record written by IP to on-board DRAM for each command
+ */
+struct Completion {
+    uint64_t seq;       // number of command since PE launch + 1, 0 if not completed
+    uint64_t status;    // NVMe status of write commands, 0 for read commands
+    uint64_t bytes;     // number of bytes transferred
+    uint64_t timestamp; // PE cycle count at completion
+};
+
+// one record per command list entry or ring entry
+#define CPL_ENTRIES RING_SIZE
+
+/**
+ * Performance counters written by IP at the end of a launch
+ */
+struct PerfCounters {
+    uint64_t cycles;
+    uint64_t completed_cmds;
+    uint64_t bytes_read;                // NVMe to on-board DRAM
+    uint64_t bytes_written;             // on-board DRAM to NVMe
+    uint64_t nvme_req_beats;
+    uint64_t nvme_rsp_beats;
+    uint64_t mem_write_stall_cycles;    // NVMe read data waiting for DRAM write channel
+    uint64_t mem_read_stall_cycles;     // waiting for DRAM read data
+    uint64_t nvme_read_stall_cycles;    // waiting for NVMe read data
+    uint64_t nvme_write_stall_cycles;   // write data waiting for NVMe
+    uint64_t latency_min;               // command latency from fetch to completion in cycles
+    uint64_t latency_max;
+    uint64_t latency_sum;
+    uint64_t read_transform;            // result of transform stage on read path, e.g. checksum
+    uint64_t write_transform;           // result of transform stage on write path
+    uint64_t reserved;
+};
+
+// predicate of filter transform: records with (record & mask) == value are selected, mask zero selects all records
+#define TRANSFORM_VALUE 0
+#define TRANSFORM_MASK 0
+
+#define BLOCK_SIZE 512
 #define NUM_BUFS 7
 std::array<uint64_t, NUM_BUFS> test_nvme_addrs = {
     0x00'0AC1'0000,
@@ -40,21 +108,21 @@ std::array<uint64_t, NUM_BUFS> test_nvme_addrs = {
     0x01'6000'0000,
     0x00'290A'C000
 };
-std::array<uint64_t, NUM_BUFS> test_len_in_pages = {
-    38144,
-    12310,
-    512,
-    423,
-    189,
-    28,
-    37
+std::array<uint64_t, NUM_BUFS> test_len_in_blocks = {
+    305152,
+    98480,
+    4096,
+    3384,
+    1512,
+    221,
+    295
 };
 
 /**
  * Generate input buffer
  *
  * @param id buffer ID
- * @param nr_pages length of buffer in number of 4K pages
+ * @param nr_blocks length of buffer in number of 512-byte blocks
  * @return vector of given length initialized with ID and incrementing values
  */
 void populate_input(std::shared_ptr<std::vector<uint64_t>> &input, const uint64_t id) {
@@ -75,7 +143,7 @@ template<size_t N>
 std::array<std::shared_ptr<std::vector<uint64_t>>, N> generate_all_inputs(std::array<uint64_t, N> &lens) {
     std::array<std::shared_ptr<std::vector<uint64_t>>, N> inputs;
     for (uint64_t i = 0; i < N; i++) {
-        size_t vector_length = lens[i] * 4096 / sizeof(uint64_t);
+        size_t vector_length = lens[i] * BLOCK_SIZE / sizeof(uint64_t);
         inputs[i] = std::make_shared<std::vector<uint64_t>>(vector_length);
         populate_input(inputs[i] , i);
     }
@@ -93,7 +161,7 @@ template<size_t N>
 std::array<std::shared_ptr<std::vector<uint64_t>>, N> allocate_outputs(std::array<uint64_t, N> &lens) {
     std::array<std::shared_ptr<std::vector<uint64_t>>, N> outputs;
     for (uint64_t i = 0; i < N; i++) {
-        size_t vector_length = lens[i] * 4096 / sizeof(uint64_t);
+        size_t vector_length = lens[i] * BLOCK_SIZE / sizeof(uint64_t);
         outputs[i] = std::make_shared<std::vector<uint64_t>>(vector_length);
     }
     return outputs;
@@ -152,7 +220,7 @@ std::array<tapasco::DeviceAddress, N> allocate_device_memory(std::shared_ptr<tap
     std::array<tapasco::DeviceAddress, N> dev_addrs{};
     for (size_t i = 0; i < N; i++) {
         tapasco::DeviceAddress a;
-        tapasco->alloc(a, lens[i] * 4096);
+        tapasco->alloc(a, lens[i] * BLOCK_SIZE);
         dev_addrs[i] = a;
     }
     return dev_addrs;
@@ -189,19 +257,15 @@ void copy_input_data(std::shared_ptr<tapasco::Tapasco> &tapasco, std::array<std:
 }
 
 /**
- * Copy output data from buffers in on-board DRAM of FPGA board to given vectors
+ * Copy output data from a single buffer in on-board DRAM of FPGA board to given vector
  *
- * @tparam N number of buffers to copy
  * @param tapasco pointer to TaPaSCo device
- * @param outputs vectors data should be copied to
- * @param dev_addrs buffer addresses containing data in on-board DRAM
+ * @param output vector data should be copied to
+ * @param dev_addr buffer address containing data in on-board DRAM
  */
-template<size_t N>
-void copy_output_data(std::shared_ptr<tapasco::Tapasco> &tapasco, std::array<std::shared_ptr<std::vector<uint64_t>>, N> &outputs,
-        std::array<tapasco::DeviceAddress, N> &dev_addrs) {
-    for (size_t i = 0; i < N; i++) {
-        tapasco->copy_from(dev_addrs[i], (uint8_t *)outputs[i]->data(), outputs[i]->size() * sizeof(uint64_t));
-    }
+void copy_output_buffer(std::shared_ptr<tapasco::Tapasco> &tapasco, std::shared_ptr<std::vector<uint64_t>> &output,
+        tapasco::DeviceAddress dev_addr) {
+    tapasco->copy_from(dev_addr, (uint8_t *)output->data(), output->size() * sizeof(uint64_t));
 }
 
 /**
@@ -222,19 +286,204 @@ std::array<Command, N> generate_commands(std::array<tapasco::DeviceAddress, N> &
     for (size_t i = 0; i < N; i++) {
         cmds[i].fpga_addr = fpga_addrs[i];
         cmds[i].nvme_addr = nvme_addrs[i];
-        cmds[i].nr_pages = lens[i];
+        cmds[i].nr_blocks = lens[i];
         cmds[i].rw = dirs[i];
     }
     return cmds;
 }
 
+/**
+ * Allocate command ring and its control block in on-board DRAM
+ *
+ * @param tapasco pointer to TaPaSCo device
+ * @param size number of command entries in ring
+ * @return command ring with initialized control block
+ */
+CommandRing allocate_command_ring(std::shared_ptr<tapasco::Tapasco> &tapasco, uint64_t size) {
+    CommandRing ring{0, 0, size, 0};
+    tapasco->alloc(ring.ring_addr, size * sizeof(Command));
+    tapasco->alloc(ring.ctrl_addr, sizeof(RingControl));
+    RingControl ctrl{};
+    tapasco->copy_to((uint8_t *)&ctrl, ring.ctrl_addr, sizeof(RingControl));
+    return ring;
+}
+
+/**
+ * Read current state of command ring from its control block
+ *
+ * @param tapasco pointer to TaPaSCo device
+ * @param ring command ring
+ * @return control block as written by IP
+ */
+RingControl read_ring_control(std::shared_ptr<tapasco::Tapasco> &tapasco, CommandRing &ring) {
+    RingControl ctrl;
+    tapasco->copy_from(ring.ctrl_addr, (uint8_t *)&ctrl, sizeof(RingControl));
+    return ctrl;
+}
+
+/**
+ * Append commands to command ring, waits for free entries if the ring is full
+ *
+ * @tparam N number of commands to append
+ * @param tapasco pointer to TaPaSCo device
+ * @param ring command ring
+ * @param cmds commands to append
+ */
+template<size_t N>
+void push_commands(std::shared_ptr<tapasco::Tapasco> &tapasco, CommandRing &ring, std::array<Command, N> &cmds) {
+    size_t i = 0;
+    while (i < N) {
+        // entries are free for reuse as soon as they have been fetched by the IP
+        auto ctrl = read_ring_control(tapasco, ring);
+        uint64_t free_entries = ring.size - (ring.tail - ctrl.head);
+        if (!free_entries) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // copy commands up to the end of the ring
+        uint64_t idx = ring.tail % ring.size;
+        uint64_t n = std::min({free_entries, (uint64_t)(N - i), ring.size - idx});
+        tapasco->copy_to((uint8_t *)&cmds[i], ring.ring_addr + idx * sizeof(Command), n * sizeof(Command));
+        i += n;
+
+        // publish new tail
+        ring.tail += n;
+        tapasco->copy_to((uint8_t *)&ring.tail, ring.ctrl_addr + offsetof(RingControl, tail), sizeof(uint64_t));
+    }
+}
+
+/**
+ * Request IP to stop after all commands in the ring have been completed
+ *
+ * @param tapasco pointer to TaPaSCo device
+ * @param ring command ring
+ */
+void stop_command_ring(std::shared_ptr<tapasco::Tapasco> &tapasco, CommandRing &ring) {
+    uint64_t stop = 1;
+    tapasco->copy_to((uint8_t *)&stop, ring.ctrl_addr + offsetof(RingControl, stop), sizeof(uint64_t));
+}
+
+/**
+ * Print performance counters of a launch
+ *
+ * @param perf counters written by IP
+ */
+void print_perf_counters(const PerfCounters &perf) {
+    auto percent = [&perf](uint64_t v) { return perf.cycles ? 100.0 * v / perf.cycles : 0.0; };
+    std::cout << "Performance counters:" << std::endl
+        << "  cycles:                  " << perf.cycles << std::endl
+        << "  completed commands:      " << perf.completed_cmds << std::endl
+        << "  bytes read from NVMe:    " << perf.bytes_read << std::endl
+        << "  bytes written to NVMe:   " << perf.bytes_written << std::endl
+        << "  NVMe request beats:      " << perf.nvme_req_beats << std::endl
+        << "  NVMe response beats:     " << perf.nvme_rsp_beats << std::endl
+        << "  DRAM write stalls:       " << perf.mem_write_stall_cycles << " (" << percent(perf.mem_write_stall_cycles) << "%)" << std::endl
+        << "  DRAM read stalls:        " << perf.mem_read_stall_cycles << " (" << percent(perf.mem_read_stall_cycles) << "%)" << std::endl
+        << "  NVMe read stalls:        " << perf.nvme_read_stall_cycles << " (" << percent(perf.nvme_read_stall_cycles) << "%)" << std::endl
+        << "  NVMe write stalls:       " << perf.nvme_write_stall_cycles << " (" << percent(perf.nvme_write_stall_cycles) << "%)" << std::endl;
+    if (perf.completed_cmds) {
+        std::cout << "  command latency:         min " << perf.latency_min << ", max " << perf.latency_max
+            << ", avg " << perf.latency_sum / perf.completed_cmds << " cycles" << std::endl;
+    }
+    std::cout << "  read transform result:   0x" << std::hex << perf.read_transform << std::endl
+        << "  write transform result:  0x" << perf.write_transform << std::dec << std::endl;
+}
+
+/**
+ * Allocate array for completion records in on-board DRAM
+ *
+ * @param tapasco pointer to TaPaSCo device
+ * @return device address of completion record array
+ */
+tapasco::DeviceAddress allocate_completion_records(std::shared_ptr<tapasco::Tapasco> &tapasco) {
+    tapasco::DeviceAddress cpl_addr;
+    tapasco->alloc(cpl_addr, CPL_ENTRIES * sizeof(Completion));
+    std::vector<Completion> records(CPL_ENTRIES);
+    tapasco->copy_to((uint8_t *)records.data(), cpl_addr, CPL_ENTRIES * sizeof(Completion));
+    return cpl_addr;
+}
+
+/**
+ * Execute commands on the IP, either by a separate launch or through the running command ring
+ *
+ * Completion records are polled while the commands are executed, so the given callback is invoked
+ * for each command as soon as it has been completed, independent of the remaining commands.
+ *
+ * @tparam N number of commands to execute
+ * @param tapasco pointer to TaPaSCo device
+ * @param pe_id ID of NVMeReaderWriter PE
+ * @param ring command ring of running PE, nullptr to launch PE for these commands only
+ * @param cpl_addr device address of completion record array
+ * @param cmds commands to execute
+ * @param on_completion callback invoked with index of each completed command
+ */
+template<size_t N>
+void execute_commands(std::shared_ptr<tapasco::Tapasco> &tapasco, tapasco::PEId pe_id, CommandRing *ring,
+    tapasco::DeviceAddress cpl_addr, std::array<Command, N> &cmds, const std::function<void(size_t)> &on_completion = {})
+{
+    // records of a batch must not be overwritten before they have been seen
+    if (N > CPL_ENTRIES) {
+        throw std::runtime_error("Number of commands exceeds number of completion records");
+    }
+
+    // records are identified by slot and command number since launch
+    uint64_t first_seq = 0;
+    std::optional<tapasco::JobFuture> task;
+    PerfCounters perf{};
+    if (ring) {
+        first_seq = ring->tail;
+        push_commands(tapasco, *ring, cmds);
+    } else {
+        std::vector<Completion> empty(N);
+        tapasco->copy_to((uint8_t *)empty.data(), cpl_addr, N * sizeof(Completion));
+        auto cmds_in = tapasco::makeInOnly(tapasco::makeWrappedPointer((uint8_t *)cmds.data(), cmds.size() * sizeof(Command)));
+        auto perf_out = tapasco::makeOutOnly(tapasco::makeWrappedPointer((uint8_t *)&perf, sizeof(PerfCounters)));
+        // ring size of zero selects list mode, single list without link to further lists
+        task = tapasco->launch(pe_id, cmds_in, cmds.size(), 0, 0, 0, 0, cpl_addr, 0, perf_out, TRANSFORM_VALUE, TRANSFORM_MASK);
+    }
+
+    std::vector<Completion> records(CPL_ENTRIES);
+    std::array<bool, N> completed{};
+    size_t nr_completed = 0;
+    while (nr_completed < N) {
+        tapasco->copy_from(cpl_addr, (uint8_t *)records.data(), CPL_ENTRIES * sizeof(Completion));
+        size_t nr_new = 0;
+        for (size_t i = 0; i < N; i++) {
+            auto &rec = records[(first_seq + i) % CPL_ENTRIES];
+            if (completed[i] || rec.seq != first_seq + i + 1) {
+                continue;
+            }
+            if (rec.status) {
+                std::cout << "ERROR: Command #" << i << " completed with status 0x" << std::hex << rec.status
+                    << std::dec << std::endl;
+            }
+            completed[i] = true;
+            ++nr_new;
+            if (on_completion) {
+                on_completion(i);
+            }
+        }
+        nr_completed += nr_new;
+        if (!nr_new) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (task) {
+        (*task)();
+        print_perf_counters(perf);
+    }
+}
+
 int main(int argc, char **argv) {
     // command line interface
     po::options_description desc;
     desc.add_options()
         ("help,h", "print this help message")
         ("reset-io-queue", "Reset IO queue for FPGA in NVMe controller before test execution")
-        ("release-io-queue", "Release IO queue FPGA in NVMe controller after test execution");
+        ("release-io-queue", "Release IO queue FPGA in NVMe controller after test execution")
+        ("ring-mode", "Launch PE once and pass all commands through a command ring");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -346,10 +595,24 @@ int main(int argc, char **argv) {
     nvme_plugin.enable();
 
     // generate input data
-    auto input_data = generate_all_inputs(test_len_in_pages);
+    auto input_data = generate_all_inputs(test_len_in_blocks);
 
     // allocate empty output buffers
-    auto output_data = allocate_outputs(test_len_in_pages);
+    auto output_data = allocate_outputs(test_len_in_blocks);
+
+    // in ring mode, the PE is launched once and runs until all iterations have been completed
+    auto cpl_addr = allocate_completion_records(tapasco);
+    std::optional<CommandRing> ring;
+    std::optional<tapasco::JobFuture> ring_task;
+    PerfCounters ring_perf{};
+    if (vm.count("ring-mode")) {
+        ring = allocate_command_ring(tapasco, RING_SIZE);
+        std::cout << "Start PE in ring mode" << std::endl;
+        auto perf_out = tapasco::makeOutOnly(tapasco::makeWrappedPointer((uint8_t *)&ring_perf, sizeof(PerfCounters)));
+        ring_task = tapasco->launch(pe_id, ring->ring_addr, 0, ring->size, ring->ctrl_addr, 0, 0, cpl_addr, 0, perf_out,
+            TRANSFORM_VALUE, TRANSFORM_MASK);
+    }
+    CommandRing *ring_ptr = ring ? &*ring : nullptr;
 
     /*
      * -----------------
@@ -359,7 +622,7 @@ int main(int argc, char **argv) {
      */
     std::array inputs_1 = {input_data[1], input_data[2], input_data[3], input_data[5]};
     std::array nvme_addrs_1 = {test_nvme_addrs[1], test_nvme_addrs[2], test_nvme_addrs[3], test_nvme_addrs[5]};
-    std::array lens_1 = {test_len_in_pages[1], test_len_in_pages[2], test_len_in_pages[3], test_len_in_pages[5]};
+    std::array lens_1 = {test_len_in_blocks[1], test_len_in_blocks[2], test_len_in_blocks[3], test_len_in_blocks[5]};
     std::array dirs_1 = {WRITE, WRITE, WRITE, WRITE};
 
     // allocate input buffer in device memory
@@ -370,12 +633,10 @@ int main(int argc, char **argv) {
 
     // generate commands for first execution
     auto cmds_1 = generate_commands(dev_addrs_1, nvme_addrs_1, lens_1, dirs_1);
-    auto cmds_1_in = tapasco::makeInOnly(tapasco::makeWrappedPointer((uint8_t *)cmds_1.data(), cmds_1.size() * sizeof(Command)));
 
-    // launch first task
+    // execute first task
     std::cout << "Start first task on PE" << std::endl;
-    auto task_1 = tapasco->launch(pe_id, cmds_1_in, cmds_1.size());
-    task_1();
+    execute_commands(tapasco, pe_id, ring_ptr, cpl_addr, cmds_1);
     std::cout << "First task on PE completed" << std::endl;
 
     // free buffers in device memory
@@ -389,30 +650,27 @@ int main(int argc, char **argv) {
      * -----------------
     */
     std::array inputs_2 = {input_data[0], input_data[4], input_data[6]};
-    std::array outputs_2 = {output_data[1], output_data[2], output_data[3], output_data[5]};
     std::array dirs_2 = {WRITE, READ, READ, READ, WRITE, READ, WRITE};
 
     // allocate buffer in device memory (input and output)
-    auto dev_addrs_2 = allocate_device_memory(tapasco, test_len_in_pages);
+    auto dev_addrs_2 = allocate_device_memory(tapasco, test_len_in_blocks);
     std::array dev_addrs_in_2 = {dev_addrs_2[0], dev_addrs_2[4], dev_addrs_2[6]};
-    std::array dev_addrs_out_2 = {dev_addrs_2[1], dev_addrs_2[2], dev_addrs_2[3], dev_addrs_2[5]};
 
     // copy input data to device memory
     copy_input_data(tapasco, inputs_2, dev_addrs_in_2);
 
     // generate commands for second execution
-    auto cmds_2 = generate_commands(dev_addrs_2, test_nvme_addrs, test_len_in_pages, dirs_2);
-    auto cmds_2_in = tapasco::makeInOnly(tapasco::makeWrappedPointer((uint8_t *)cmds_2.data(), cmds_2.size() * sizeof(Command)));
+    auto cmds_2 = generate_commands(dev_addrs_2, test_nvme_addrs, test_len_in_blocks, dirs_2);
 
-    // launch second task
+    // execute second task, output data is copied as soon as the corresponding read command completed
     std::cout << "Start second task on PE" << std::endl;
-    auto task_2 = tapasco->launch(pe_id, cmds_2_in, cmds_2.size());
-    task_2();
+    execute_commands(tapasco, pe_id, ring_ptr, cpl_addr, cmds_2, [&](size_t i) {
+        if (dirs_2[i] == READ) {
+            copy_output_buffer(tapasco, output_data[i], dev_addrs_2[i]);
+        }
+    });
     std::cout << "Second task on PE completed" << std::endl;
 
-    // copy output data
-    copy_output_data(tapasco, outputs_2, dev_addrs_out_2);
-
     // free buffers in device memory
     free_device_memory(tapasco, dev_addrs_2);
 
@@ -424,28 +682,36 @@ int main(int argc, char **argv) {
     */
     std::array outputs_3 = {output_data[0], output_data[4], output_data[6]};
     std::array nvme_addrs_3 = {test_nvme_addrs[0], test_nvme_addrs[4], test_nvme_addrs[6]};
-    std::array lens_3 = {test_len_in_pages[0], test_len_in_pages[4], test_len_in_pages[6]};
+    std::array lens_3 = {test_len_in_blocks[0], test_len_in_blocks[4], test_len_in_blocks[6]};
     std::array dirs_3 = {READ, READ, READ};
 
     // allocate buffer in device memory (input and output)
     auto dev_addrs_3 = allocate_device_memory(tapasco, lens_3);
 
-    // generate commands for second execution
+    // generate commands for third execution
     auto cmds_3 = generate_commands(dev_addrs_3, nvme_addrs_3, lens_3, dirs_3);
-    auto cmds_3_in = tapasco::makeInOnly(tapasco::makeWrappedPointer((uint8_t *)cmds_3.data(), cmds_3.size() * sizeof(Command)));
 
-    // launch second task
+    // execute third task, output data is copied as soon as the corresponding read command completed
     std::cout << "Start third task on PE" << std::endl;
-    auto task_3 = tapasco->launch(pe_id, cmds_3_in, cmds_3.size());
-    task_3();
+    execute_commands(tapasco, pe_id, ring_ptr, cpl_addr, cmds_3, [&](size_t i) {
+        copy_output_buffer(tapasco, outputs_3[i], dev_addrs_3[i]);
+    });
     std::cout << "Third task on PE completed" << std::endl;
 
-    // copy output data
-    copy_output_data(tapasco, outputs_3, dev_addrs_3);
-
     // free buffers in device memory
     free_device_memory(tapasco, dev_addrs_3);
 
+    // stop PE in ring mode and release command ring
+    if (ring) {
+        stop_command_ring(tapasco, *ring);
+        (*ring_task)();
+        std::cout << "PE in ring mode stopped" << std::endl;
+        print_perf_counters(ring_perf);
+        tapasco->free(ring->ring_addr);
+        tapasco->free(ring->ctrl_addr);
+    }
+    tapasco->free(cpl_addr);
+
     // disable NVMe plugin
     nvme_plugin.disable();
 
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Compare the default window graph and the fused stream graph (AIE_GRAPH=stream):
+# x86sim checks the results, aiesim measures first-result latency and throughput of lane 0.
+# Run from the aie directory with VITIS_BASE and PLATFORM_FILE set, e.g. 'bash sim/compare.sh 8192'.
+# The norm type is taken from NORM (default: l2), both graphs are compared for two components.
+samples=${1:-8192}
+lanes=${AIE_LANES:-2}
+norm=${NORM:-l2}
+
+# check results of all lanes against the norm of (x, y)
+check_results() {
+	local dir=$1
+	for ((l = 0; l < lanes; l++)); do
+		grep -v '^T' $dir/data/out_z_$l.txt | paste -d ' ' data/in_x_$l.txt data/in_y_$l.txt - | awk -v lane=$l -v norm=$norm '
+			function abs(v) { return v < 0 ? -v : v }
+			{
+				for (i = 1; i <= 4; i++) {
+					x = $i; y = $(i + 4); act = $(i + 8)
+					if (norm == "l1") ref = abs(x) + abs(y)
+					else if (norm == "linf") ref = abs(x) > abs(y) ? abs(x) : abs(y)
+					else if (norm == "l2sq") ref = x * x + y * y
+					else ref = sqrt(x * x + y * y)
+					if (act == "" || (ref - act > ref * 1e-5) || (act - ref > ref * 1e-5)) { err++ }
+				}
+			}
+			END {
+				if (NR * 4 != '$samples') { print "ERROR: lane " lane ": " NR * 4 " results"; exit 1 }
+				if (err) { print "ERROR: lane " lane ": " err " wrong results"; exit 1 }
+			}' || return 1
+	done
+}
+
+# first and last timestamp of lane 0 in ns
+timing() {
+	awk '/^T / { t = ($3 == "ps") ? $2 / 1000 : $2; if (!n++) first = t; last = t }
+		END { printf "%.1f %.1f", first, last }' aiesimulator_output/data/out_z_0.txt
+}
+
+declare -A latency throughput
+for graph in window stream; do
+	echo "=== ${graph} graph ==="
+	make clean > /dev/null
+	if ! make AIE_GRAPH=$graph AIE_LANES=$lanes NORM=$norm SIM_SAMPLES=$samples x86sim > x86sim_$graph.log 2>&1; then
+		echo "ERROR: x86sim failed, see x86sim_$graph.log"
+		exit 1
+	fi
+	check_results x86simulator_output || exit 1
+	echo "x86sim: results correct"
+
+	if ! make AIE_GRAPH=$graph AIE_LANES=$lanes NORM=$norm SIM_SAMPLES=$samples aiesim > aiesim_$graph.log 2>&1; then
+		echo "ERROR: aiesim failed, see aiesim_$graph.log"
+		exit 1
+	fi
+	read first last <<< "$(timing)"
+	latency[$graph]=$first
+	throughput[$graph]=$(awk -v n=$samples -v f=$first -v l=$last 'BEGIN { printf "%.1f", (l > f) ? n * 1000 / (l - f) : 0 }')
+	echo "aiesim: first result after ${latency[$graph]} ns, ${throughput[$graph]} MSamples/s per lane"
+done
+
+echo
+printf "%-8s %20s %28s\n" graph "first result (ns)" "throughput (MSamples/s/lane)"
+for graph in window stream; do
+	printf "%-8s %20s %28s\n" $graph ${latency[$graph]} ${throughput[$graph]}
+done
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# generate PLIO input files for x86sim/aiesim: <lanes> lanes with <samples> samples of <dims> components each,
+# four floats (one 128-bit beat) per line, component c of sample j of lane l is n + c with n = l * samples + j
+lanes=${1:-2}
+samples=${2:-8192}
+dims=${3:-2}
+components=(x y z w)
+
+mkdir -p data
+for ((l = 0; l < lanes; l++)); do
+	for ((c = 0; c < dims; c++)); do
+		awk -v l=$l -v n=$samples -v c=$c 'BEGIN { for (j = 0; j < n; j += 4) { b = l * n + j + c; print b, b + 1, b + 2, b + 3 } }' > data/in_${components[$c]}_$l.txt
+	done
+done
@@ -0,0 +1,22 @@
+#include "kernels.h"
+#include <adf.h>
+#include <aie_api/aie.hpp>
+
+template <NormType NORM, bool FINAL>
+void combine_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_a, adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_b,
+		adf::output_buffer<float, adf::extents<WINDOW_SIZE>> &out) {
+	auto inAIt = aie::cbegin_vector<VECTOR_SIZE>(in_a);
+	auto inBIt = aie::cbegin_vector<VECTOR_SIZE>(in_b);
+	auto outIt = aie::begin_vector<VECTOR_SIZE>(out);
+
+	for (int i = 0; i < WINDOW_SIZE / VECTOR_SIZE; ++i) {
+		auto inA_i = *inAIt++;
+		auto inB_i = *inBIt++;
+		if constexpr (NORM == NORM_LINF)
+			*outIt++ = aie::max(inA_i, inB_i);
+		else if constexpr (NORM == NORM_L2 && FINAL)
+			*outIt++ = aie::sqrt(aie::add(inA_i, inB_i));
+		else
+			*outIt++ = aie::add(inA_i, inB_i);
+	}
+}
@@ -0,0 +1,17 @@
+#include "kernels.h"
+#include <adf.h>
+#include <aie_api/aie.hpp>
+
+template <NormType NORM>
+void component_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in, adf::output_buffer<float, adf::extents<WINDOW_SIZE>> &out) {
+	auto inIt = aie::cbegin_vector<VECTOR_SIZE>(in);
+	auto outIt = aie::begin_vector<VECTOR_SIZE>(out);
+
+	for (int i = 0; i < WINDOW_SIZE / VECTOR_SIZE; ++i) {
+		auto in_i = *inIt++;
+		if constexpr (NORM == NORM_L1 || NORM == NORM_LINF)
+			*outIt++ = aie::abs(in_i);
+		else
+			*outIt++ = aie::mul(in_i, in_i);
+	}
+}
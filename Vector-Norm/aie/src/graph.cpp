@@ -2,12 +2,23 @@
 #include <stdio.h>
 
 
-vecNormGraph my_graph;
+#if defined(AIE_STREAM_GRAPH)
+vecNormStreamGraph<AIE_LANES, VN_NORM, VN_DIM> my_graph;
+#elif defined(AIE_REDUCE_GRAPH)
+vecNormReduceGraph<AIE_LANES, VN_NORM> my_graph;
+#else
+vecNormGraph<AIE_LANES, VN_NORM, VN_DIM> my_graph;
+#endif
+
+// samples per lane processed in x86sim/aiesim, must match the input files in data/ (see sim/compare.sh)
+#ifndef SIM_SAMPLES
+#define SIM_SAMPLES WINDOW_SIZE
+#endif
 
 int main(int argc, char ** argv)
 {
 	my_graph.init();
-	my_graph.run(1);
+	my_graph.run(SIM_SAMPLES / my_graph.ITERATION_SAMPLES);
 	my_graph.end();
 
 
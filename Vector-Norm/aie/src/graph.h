@@ -3,36 +3,132 @@
 #include "adf.h"
 #include "kernels.h"
 
+#include <string>
+
 using namespace adf;
 
+// Number of parallel pipelines, must match AIE_LANES in hw/DataStreamerVN/src/VecNormSplit.bsv (set by build_bitstream.sh).
+// Two lanes of 128-bit PLIOs for x and y each match the bandwidth of the 512-bit DMA stream.
+// With 16-bit input types, samples are expanded to fp32 in the PL, so four lanes are required.
+// With DIM components, a lane has DIM input PLIOs, see the README for the minimum number of lanes.
+#ifndef AIE_LANES
+#define AIE_LANES 2
+#endif
+
+// PLIO of component c (x, y, z, w) of lane l
+static inline std::string componentPlio(int c, int l) {
+	return std::string("in_") + "xyzw"[c] + "_" + std::to_string(l);
+}
+
+// Default graph: DIM component kernels per lane (|x| or x*x) feed a chain of DIM - 1 combine kernels
+// (sum or maximum, square root for L2 in the last one) through windows of WINDOW_SIZE samples.
+// For the 2-D L2 norm, this is two square kernels feeding one sum/sqrt kernel.
+template <int LANES, NormType NORM, int DIM>
 class vecNormGraph : public graph {
 private:
-	kernel square_k[2];
-	kernel sum_sqrt_k;
+	kernel component_k[LANES][DIM];
+	kernel combine_k[LANES][DIM - 1];
 
 public:
-	input_plio in_x, in_y;
-	output_plio out_z;
+	input_plio in[LANES][DIM];
+	output_plio out_z[LANES];
+
+	// samples per lane and graph iteration
+	static constexpr int ITERATION_SAMPLES = WINDOW_SIZE;
 
 	vecNormGraph() {
-		in_x = input_plio::create("in_x", plio_128_bits, "data/in_x.txt");
-		in_y = input_plio::create("in_y", plio_128_bits, "data/in_y.txt");
-		out_z = output_plio::create("out_z", plio_128_bits, "data/out_z.txt");
-
-		for (int i = 0; i < 2; ++i) {
-			square_k[i] = kernel::create(square_kernel);
-			source(square_k[i]) = "square.cpp";
-			runtime<ratio>(square_k[i]) = 1;
+		for (int l = 0; l < LANES; ++l) {
+			std::string idx = std::to_string(l);
+			out_z[l] = output_plio::create("out_z_" + idx, plio_128_bits, "data/out_z_" + idx + ".txt");
+
+			for (int c = 0; c < DIM; ++c) {
+				in[l][c] = input_plio::create(componentPlio(c, l), plio_128_bits, "data/" + componentPlio(c, l) + ".txt");
+				component_k[l][c] = kernel::create(component_kernel<NORM>);
+				source(component_k[l][c]) = "component.cpp";
+				runtime<ratio>(component_k[l][c]) = 1;
+				connect(in[l][c].out[0], component_k[l][c].in[0]);
+			}
+			for (int i = 0; i < DIM - 1; ++i) {
+				combine_k[l][i] = kernel::create(i == DIM - 2 ? combine_kernel<NORM, true> : combine_kernel<NORM, false>);
+				source(combine_k[l][i]) = "combine.cpp";
+				runtime<ratio>(combine_k[l][i]) = 1;
+				if (i == 0)
+					connect(component_k[l][0].out[0], combine_k[l][i].in[0]);
+				else
+					connect(combine_k[l][i - 1].out[0], combine_k[l][i].in[0]);
+				connect(component_k[l][i + 1].out[0], combine_k[l][i].in[1]);
+			}
+			connect(combine_k[l][DIM - 2].out[0], out_z[l].in[0]);
 		}
-		sum_sqrt_k = kernel::create(sum_sqrt_kernel);
-		source(sum_sqrt_k) =  "sum_sqrt.cpp";
-		runtime<ratio>(sum_sqrt_k) = 1;
-
-		connect(in_x.out[0], square_k[0].in[0]);
-		connect(in_y.out[0], square_k[1].in[0]);
-		connect(square_k[0].out[0], sum_sqrt_k.in[0]);
-		connect(square_k[1].out[0], sum_sqrt_k.in[1]);
-		connect(sum_sqrt_k.out[0], out_z.in[0]);
 	}
 };
 
+// Fused graph (AIE_GRAPH=stream): one kernel per lane computes the norm directly on the PLIO streams.
+// It avoids the tile hops and ping-pong buffers of the default graph, so first results leave the graph
+// after a few samples instead of after two full windows. The PLIOs are identical to vecNormGraph.
+// An AIE tile has two input streams, so this graph is limited to two components.
+template <int LANES, NormType NORM, int DIM>
+class vecNormStreamGraph : public graph {
+	static_assert(DIM == 2, "the stream graph supports DIM=2 only");
+
+private:
+	kernel norm_k[LANES];
+
+public:
+	input_plio in_x[LANES], in_y[LANES];
+	output_plio out_z[LANES];
+
+	// samples per lane and graph iteration
+	static constexpr int ITERATION_SAMPLES = STREAM_BLOCK_SIZE;
+
+	vecNormStreamGraph() {
+		for (int l = 0; l < LANES; ++l) {
+			std::string idx = std::to_string(l);
+			in_x[l] = input_plio::create("in_x_" + idx, plio_128_bits, "data/in_x_" + idx + ".txt");
+			in_y[l] = input_plio::create("in_y_" + idx, plio_128_bits, "data/in_y_" + idx + ".txt");
+			out_z[l] = output_plio::create("out_z_" + idx, plio_128_bits, "data/out_z_" + idx + ".txt");
+
+			norm_k[l] = kernel::create(norm_stream_kernel<NORM>);
+			source(norm_k[l]) = "norm_stream.cpp";
+			runtime<ratio>(norm_k[l]) = 0.9;
+
+			connect(in_x[l].out[0], norm_k[l].in[0]);
+			connect(in_y[l].out[0], norm_k[l].in[1]);
+			connect(norm_k[l].out[0], out_z[l].in[0]);
+		}
+	}
+};
+
+// Reduction graph (AIE_GRAPH=reduce): one kernel per lane returns 16 partial results per window,
+// which the PE combines to one result per segment (MODE=reduce of DataStreamerVN).
+// The norms of the supported types reduce over all elements of a segment regardless of the sample they
+// belong to, so the PE sends the elements in pairs on 'x' and 'y' for any DIM.
+template <int LANES, NormType NORM>
+class vecNormReduceGraph : public graph {
+private:
+	kernel reduce_k[LANES];
+
+public:
+	input_plio in_x[LANES], in_y[LANES];
+	output_plio out_z[LANES];
+
+	// samples per lane and graph iteration
+	static constexpr int ITERATION_SAMPLES = WINDOW_SIZE;
+
+	vecNormReduceGraph() {
+		for (int l = 0; l < LANES; ++l) {
+			std::string idx = std::to_string(l);
+			in_x[l] = input_plio::create("in_x_" + idx, plio_128_bits, "data/in_x_" + idx + ".txt");
+			in_y[l] = input_plio::create("in_y_" + idx, plio_128_bits, "data/in_y_" + idx + ".txt");
+			out_z[l] = output_plio::create("out_z_" + idx, plio_128_bits, "data/out_z_" + idx + ".txt");
+
+			reduce_k[l] = kernel::create(reduce_kernel<NORM>);
+			source(reduce_k[l]) = "reduce.cpp";
+			runtime<ratio>(reduce_k[l]) = 1;
+
+			connect(in_x[l].out[0], reduce_k[l].in[0]);
+			connect(in_y[l].out[0], reduce_k[l].in[1]);
+			connect(reduce_k[l].out[0], out_z[l].in[0]);
+		}
+	}
+};
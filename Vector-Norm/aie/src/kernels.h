@@ -2,9 +2,27 @@
 
 #include <adf.h>
 
+#include "norm_type.h"
+
 #define WINDOW_SIZE 1024
 #define VECTOR_SIZE 8
 
-void square_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in, adf::output_buffer<float, adf::extents<WINDOW_SIZE>> &out);
-void sum_sqrt_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_x, adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_y,
+// fused stream kernel: samples per invocation and per 128-bit stream access
+#define STREAM_BLOCK_SIZE 256
+#define STREAM_VECTOR_SIZE 4
+
+// reduction kernel: partial results per window (one 512-bit beat of the PE)
+#define REDUCE_OUTPUT_SIZE 16
+
+// |x| for L1 and L-infinity, x*x for L2 and squared L2
+template <NormType NORM>
+void component_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in, adf::output_buffer<float, adf::extents<WINDOW_SIZE>> &out);
+// maximum for L-infinity, sum otherwise; the final kernel of an L2 lane takes the square root
+template <NormType NORM, bool FINAL>
+void combine_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_a, adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_b,
 		adf::output_buffer<float, adf::extents<WINDOW_SIZE>> &out);
+template <NormType NORM>
+void norm_stream_kernel(input_stream<float> *in_x, input_stream<float> *in_y, output_stream<float> *out);
+template <NormType NORM>
+void reduce_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_x, adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_y,
+		adf::output_buffer<float, adf::extents<REDUCE_OUTPUT_SIZE>> &out);
@@ -0,0 +1,26 @@
+#include "kernels.h"
+#include <adf.h>
+#include <aie_api/aie.hpp>
+
+template <NormType NORM>
+void norm_stream_kernel(input_stream<float> *in_x, input_stream<float> *in_y, output_stream<float> *out) {
+	for (int i = 0; i < STREAM_BLOCK_SIZE / STREAM_VECTOR_SIZE; ++i)
+		chess_prepare_for_pipelining
+	{
+		aie::vector<float, STREAM_VECTOR_SIZE> x = readincr_v<STREAM_VECTOR_SIZE>(in_x);
+		aie::vector<float, STREAM_VECTOR_SIZE> y = readincr_v<STREAM_VECTOR_SIZE>(in_y);
+		if constexpr (NORM == NORM_L1)
+			writeincr(out, aie::add(aie::abs(x), aie::abs(y)));
+		else if constexpr (NORM == NORM_LINF)
+			writeincr(out, aie::max(aie::abs(x), aie::abs(y)));
+		else {
+			// products are accumulators, convert them before adding
+			aie::vector<float, STREAM_VECTOR_SIZE> sum = aie::add(aie::mul(x, x).to_vector<float>(),
+					aie::mul(y, y).to_vector<float>());
+			if constexpr (NORM == NORM_L2_SQUARED)
+				writeincr(out, sum);
+			else
+				writeincr(out, aie::sqrt(sum));
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Norm computed over the components of a sample, shared by the AIE graph and the host application.
+// Selected at compile time with NORM and DIM (aie/Makefile, hw/DataStreamerVN/Makefile, sw/C++/CMakeLists.txt).
+enum NormType {
+	NORM_L1,         // |x| + |y| + ...
+	NORM_L2,         // sqrt(x*x + y*y + ...)
+	NORM_L2_SQUARED, // x*x + y*y + ...
+	NORM_LINF        // max(|x|, |y|, ...)
+};
+
+#ifndef VN_NORM
+#define VN_NORM NORM_L2
+#endif
+
+// interleaved components per sample (x, y, z, w)
+#ifndef VN_DIM
+#define VN_DIM 2
+#endif
+
+static_assert(VN_DIM >= 2 && VN_DIM <= 4, "VN_DIM must be 2, 3 or 4");
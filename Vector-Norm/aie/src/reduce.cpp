@@ -0,0 +1,45 @@
+#include "kernels.h"
+#include <adf.h>
+#include <aie_api/aie.hpp>
+
+// partial results of a window for the reduction mode of the PE, which combines the 16 values of all windows of
+// a segment: sums of x*x + y*y (L2, squared L2), sums of |x| + |y| (L1) or maxima of |x|, |y| (L-infinity)
+template <NormType NORM>
+void reduce_kernel(adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_x, adf::input_buffer<float, adf::extents<WINDOW_SIZE>> &in_y,
+		adf::output_buffer<float, adf::extents<REDUCE_OUTPUT_SIZE>> &out) {
+	auto inXIt = aie::cbegin_vector<VECTOR_SIZE>(in_x);
+	auto inYIt = aie::cbegin_vector<VECTOR_SIZE>(in_y);
+	auto outIt = aie::begin_vector<VECTOR_SIZE>(out);
+
+	if constexpr (NORM == NORM_LINF) {
+		aie::vector<float, VECTOR_SIZE> max0 = aie::zeros<float, VECTOR_SIZE>();
+		aie::vector<float, VECTOR_SIZE> max1 = aie::zeros<float, VECTOR_SIZE>();
+		for (int i = 0; i < WINDOW_SIZE / VECTOR_SIZE / 2; ++i) {
+			max0 = aie::max(max0, aie::max(aie::abs(*inXIt++), aie::abs(*inYIt++)));
+			max1 = aie::max(max1, aie::max(aie::abs(*inXIt++), aie::abs(*inYIt++)));
+		}
+		*outIt++ = max0;
+		*outIt++ = max1;
+	} else {
+		// two independent accumulators hide the latency of the floating-point MAC
+		aie::accum<accfloat, VECTOR_SIZE> acc0 = aie::zeros<accfloat, VECTOR_SIZE>();
+		aie::accum<accfloat, VECTOR_SIZE> acc1 = aie::zeros<accfloat, VECTOR_SIZE>();
+		for (int i = 0; i < WINDOW_SIZE / VECTOR_SIZE / 2; ++i) {
+			auto inX0 = *inXIt++;
+			auto inY0 = *inYIt++;
+			auto inX1 = *inXIt++;
+			auto inY1 = *inYIt++;
+			if constexpr (NORM == NORM_L1) {
+				acc0 = aie::add(acc0, aie::add(aie::abs(inX0), aie::abs(inY0)));
+				acc1 = aie::add(acc1, aie::add(aie::abs(inX1), aie::abs(inY1)));
+			} else {
+				acc0 = aie::mac(acc0, inX0, inX0);
+				acc0 = aie::mac(acc0, inY0, inY0);
+				acc1 = aie::mac(acc1, inX1, inX1);
+				acc1 = aie::mac(acc1, inY1, inY1);
+			}
+		}
+		*outIt++ = acc0.to_vector<float>();
+		*outIt++ = acc1.to_vector<float>();
+	}
+}
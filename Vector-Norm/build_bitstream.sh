@@ -1,5 +1,62 @@
 #!/bin/bash
 
+# variant: input from host memory via DMA streaming (default), directly from NVMe ('nvme') or from on-board
+# memory with the norm computed in the PL ('mem'), the latter composed PE_COUNT times (default: 4)
+pe=DataStreamerVN
+pe_id=8847
+job_file=vector-norm.json
+features=312.5+AI-Engine+DMA-Streaming
+pe_count=1
+if [ "$1" == "nvme" ]; then
+	pe=NVMeStreamerVN
+	pe_id=8848
+	job_file=nvme-vector-norm.json
+	features=312.5+AI-Engine+NVME
+elif [ "$1" == "mem" ]; then
+	pe=MemStreamerVN
+	pe_id=8849
+	job_file=mem-vector-norm.json
+	features=312.5
+	pe_count=${PE_COUNT:-4}
+fi
+
+# norm: NORM=l1|l2|l2sq|linf (default: l2) over DIM=2|3|4 interleaved components per sample (default: 2),
+# NVMeStreamerVN, MemStreamerVN and the stream graph support two components only
+norm=${NORM:-l2}
+dims=${DIM:-2}
+if [ "${dims}" != "2" ] && { [ "${pe}" != "DataStreamerVN" ] || [ "${AIE_GRAPH}" == "stream" ]; }; then
+	echo "DIM=${dims} is only supported by DataStreamerVN with the window graph"
+	exit
+fi
+
+# MODE=reduce returns one result per segment instead of elementwise norms and requires the reduction graph,
+# which receives pairs of elements for any DIM
+aie_graph=${AIE_GRAPH:-window}
+split_dims=${dims}
+if [ "${MODE}" == "reduce" ]; then
+	aie_graph=reduce
+	split_dims=2
+fi
+
+# element types of DataStreamerVN: INPUT_TYPE=bf16|fp16 and OUTPUT_TYPE=bf16 (default: fp32),
+# 16-bit inputs are expanded to twice the words per DMA beat. A lane takes four samples per round,
+# so the minimum number of lanes is the number of rounds per expanded beat, rounded up to a power of two.
+in_words=16
+if [ "${pe}" == "DataStreamerVN" ] && { [ "${INPUT_TYPE}" == "bf16" ] || [ "${INPUT_TYPE}" == "fp16" ]; }; then
+	in_words=32
+fi
+min_lanes=1
+while (( min_lanes * 4 * split_dims < in_words )); do
+	min_lanes=$((min_lanes * 2))
+done
+
+# number of AIE lanes: AIE_LANES=<n> replicates the pipeline of the graph n times (multiple of the minimum)
+aie_lanes=${AIE_LANES:-${min_lanes}}
+if (( aie_lanes % min_lanes )); then
+	echo "AIE_LANES must be a multiple of ${min_lanes}"
+	exit
+fi
+
 # check environment variables
 if [ -z "${VITIS_BASE}" ]; then
 	echo "VITIS_BASE is not set. Please set it to your Vitis installation directory path."
@@ -43,21 +100,29 @@ fi
 
 # build Bluespec cores
 echo "Building Bluespec cores..."
-pushd . && cd hw/DataStreamerVN && make SIM_TYPE=VERILOG ip && popd
+pushd . && cd hw/${pe} && make SIM_TYPE=VERILOG INPUT_TYPE=${INPUT_TYPE} OUTPUT_TYPE=${OUTPUT_TYPE} MODE=${MODE} NORM=${norm} DIM=${dims} AIE_LANES=${aie_lanes} NORM_LANES=${NORM_LANES} ip && popd
 
-# build AIE graph
-echo "Compiling AIE graph..."
-pushd . && pwd && cd aie && make && popd
+if [ "${pe}" == "MemStreamerVN" ]; then
+	# no AIE graph, the number of PEs is set in the job file
+	echo "Generating device image"
+	sed -e "s/\"Count\": [0-9]*/\"Count\": ${pe_count}/" ${job_file} > build/${job_file}
+else
+	# build AIE graph
+	echo "Compiling AIE graph..."
+	pushd . && pwd && cd aie && make AIE_LANES=${aie_lanes} AIE_GRAPH=${aie_graph} NORM=${norm} DIM=${dims} && popd
 
-# build TaPaSCo bitstream
-echo "Generating device image"
-sed -i "s,PATH_TO_THIS_REPO,$PWD,g" vector-norm.json
-tapasco import hw/DataStreamerVN/build/ip/DataStreamerVN.zip as 8847 -p vck5000
-tapasco --jobsFile vector-norm.json
+	# build TaPaSCo bitstream
+	echo "Generating device image"
+	# PLIO connections of all lanes are generated from the job file
+	bash gen_job_file.sh ${job_file} ${aie_lanes} ${split_dims} > build/${job_file}
+fi
+tapasco import hw/${pe}/build/ip/${pe}.zip as ${pe_id} -p vck5000
+tapasco --jobsFile build/${job_file}
 
-if [ -f $TAPASCO_WORK_DIR/compose/axi4mm/vck5000/DataStreamerVN/001/312.5+AI-Engine+DMA-Streaming/axi4mm-vck5000--DataStreamerVN_1--313.pdi ]; then
+pdi_file_path=$TAPASCO_WORK_DIR/compose/axi4mm/vck5000/${pe}/$(printf "%03d" ${pe_count})/${features}/axi4mm-vck5000--${pe}_${pe_count}--313.pdi
+if [ -f ${pdi_file_path} ]; then
 	echo "Device image created successfully"
-	echo "PDI file: $TAPASCO_WORK_DIR/compose/axi4mm/vck5000/DataStreamerVN/001/312.5+AI-Engine+DMA-Streaming/axi4mm-vck5000--DataStreamerVN_1--313.pdi"
+	echo "PDI file: ${pdi_file_path}"
 else
 	echo "ERROR: Failed to create device image"
 fi
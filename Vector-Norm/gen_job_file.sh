@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# generate a TaPaSCo job file for <lanes> AIE lanes and <dims> components per sample (default: 2) from a job file
+# template (e.g. vector-norm.json): the PLIO connections in_<x|y|z|w>_<n> and out_z_<n> are replaced by one set
+# per lane and PATH_TO_THIS_REPO is set to this directory. Component c of lane n is connected to PE port
+# M_AXIS_AIE_IN_<c>_<n> (DataStreamerVN), or M_AXIS_AIE_X_<n> and M_AXIS_AIE_Y_<n> if the template uses these.
+if [ $# -lt 2 ] || [ $# -gt 3 ]; then
+	echo "Usage: $0 <template job file> <lanes> [<dims>]"
+	exit 1
+fi
+
+style=xy
+if grep -q "M_AXIS_AIE_IN_" $1; then
+	style=in
+fi
+
+awk -v lanes=$2 -v dims=${3:-2} -v style=$style -v repo="$PWD" '
+	/"(in_[xyzw]|out_z)_[0-9]+"/ {
+		if (!done) {
+			for (l = 0; l < lanes; l++) {
+				for (c = 0; c < dims; c++) {
+					comp = substr("xyzw", c + 1, 1)
+					if (style == "in")
+						printf "        \"in_%s_%d\": \"M_AXIS_AIE_IN_%d_%d\",\n", comp, l, c, l
+					else
+						printf "        \"in_%s_%d\": \"M_AXIS_AIE_%s_%d\",\n", comp, l, toupper(comp), l
+				}
+				printf "        \"out_z_%d\": \"S_AXIS_AIE_%d\"%s\n", l, l, (l < lanes - 1) ? "," : ""
+			}
+			done = 1
+		}
+		next
+	}
+	{ gsub("PATH_TO_THIS_REPO", repo); print }
+' $1
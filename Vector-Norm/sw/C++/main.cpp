@@ -1,17 +1,233 @@
 #include <iostream>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
 
 #include <boost/program_options.hpp>
 #include <chrono>
+#include <thread>
 #include <tapasco.hpp>
 
+#include "norm.hpp"
+#include "soa_packer.hpp"
+
 #define DEFAULT_SAMPLES 16384
 #define PE_NAME "esa.informatik.tu-darmstadt.de:user:DataStreamerVN:1.0"
+// packet mode: the PE is stopped if no packet completes within this time
+#define PACKET_TIMEOUT_MS 10000
+
+/**
+ * Element types of the DMA streams, must match INPUT_TYPE and OUTPUT_TYPE of the PE (see CMakeLists.txt).
+ * 16-bit types are stored as raw bits and converted on the host for the reference computation.
+ */
+#if defined(VN_INPUT_BF16) || defined(VN_INPUT_FP16)
+typedef uint16_t input_t;
+#else
+typedef float input_t;
+#endif
+#ifdef VN_OUTPUT_BF16
+typedef uint16_t output_t;
+#else
+typedef float output_t;
+#endif
+
+// results per 64-byte DMA beat, packets in packet mode must start at a beat boundary
+#define SAMPLES_PER_RESULT_BEAT (64 / sizeof(output_t))
+// packets (and segments) must also start at an input beat boundary
+#define INPUT_BEAT_ALIGNED(samples) ((samples) * VN_DIM * sizeof(input_t) % 64 == 0)
+
+float bits_to_float(uint32_t b) {
+        float f;
+        std::memcpy(&f, &b, sizeof(f));
+        return f;
+}
+
+uint32_t float_to_bits(float f) {
+        uint32_t b;
+        std::memcpy(&b, &f, sizeof(b));
+        return b;
+}
+
+/**
+ * Convert between host floats and stream elements (round to nearest even, fp16 without subnormals as in the PE)
+ */
+input_t to_input(float f) {
+#if defined(VN_INPUT_BF16)
+        uint32_t b = float_to_bits(f);
+        return (b + 0x7fff + ((b >> 16) & 1)) >> 16;
+#elif defined(VN_INPUT_FP16)
+        uint32_t b = float_to_bits(f);
+        uint16_t sign = (b >> 16) & 0x8000;
+        int exp = ((b >> 23) & 0xff) - 112;
+        uint32_t mant = b & 0x7fffff;
+        if (exp <= 0)
+                return sign;
+        uint32_t rounded = ((exp << 23) | mant) + 0xfff + ((mant >> 13) & 1);
+        if ((rounded >> 23) >= 31)
+                return sign | 0x7c00;
+        return sign | (rounded >> 13);
+#else
+        return f;
+#endif
+}
+
+float from_input(input_t e) {
+#if defined(VN_INPUT_BF16)
+        return bits_to_float((uint32_t)e << 16);
+#elif defined(VN_INPUT_FP16)
+        uint32_t exp = (e >> 10) & 0x1f;
+        uint32_t sign = (uint32_t)(e & 0x8000) << 16;
+        if (exp == 0)
+                return bits_to_float(sign);
+        return bits_to_float(sign | ((exp == 0x1f ? 0xff : exp + 112) << 23) | ((uint32_t)(e & 0x3ff) << 13));
+#else
+        return e;
+#endif
+}
+
+float from_output(output_t e) {
+#ifdef VN_OUTPUT_BF16
+        return bits_to_float((uint32_t)e << 16);
+#else
+        return e;
+#endif
+}
+
+/**
+ * Performance counters written by PE at the end of a launch
+ */
+struct PerfCounters {
+        uint64_t cycles;
+        uint64_t in_beats;              // DMA beats received
+        uint64_t out_beats;             // DMA beats sent
+        uint64_t in_empty;              // cycles waiting for input from DMA
+        uint64_t in_full;               // cycles input from DMA back-pressured by PE
+        uint64_t aie_send_stalls;       // cycles x/y streams not accepted by AIE graph
+        uint64_t aie_receive_starved;   // cycles waiting for results from AIE graph
+        uint64_t out_stalls;            // cycles results not accepted by DMA
+};
+
+/**
+ * Control block of packet mode in on-board DRAM (one 64-byte line polled by PE)
+ */
+struct StreamControl {
+        uint64_t stop;          // written by host: stop PE at the end of the current packet
+        uint64_t packets;       // written by PE: number of result packets sent
+        uint64_t reserved[6];
+};
+
+/**
+ * Print performance counters and the stage which limited throughput
+ */
+void print_perf_counters(const PerfCounters &perf) {
+        auto percent = [&perf](uint64_t v) { return perf.cycles ? 100.0 * v / perf.cycles : 0.0; };
+        std::cout << "Performance counters:" << std::endl
+                << "  cycles:                " << perf.cycles << std::endl
+                << "  input beats:           " << perf.in_beats << " (" << percent(perf.in_beats) << "% of line rate)" << std::endl
+                << "  output beats:          " << perf.out_beats << std::endl
+                << "  input empty:           " << perf.in_empty << " (" << percent(perf.in_empty) << "%)" << std::endl
+                << "  input full:            " << perf.in_full << " (" << percent(perf.in_full) << "%)" << std::endl
+                << "  AIE send stalls:       " << perf.aie_send_stalls << " (" << percent(perf.aie_send_stalls) << "%)" << std::endl
+                << "  AIE receive starved:   " << perf.aie_receive_starved << " (" << percent(perf.aie_receive_starved) << "%)" << std::endl
+                << "  output stalls:         " << perf.out_stalls << " (" << percent(perf.out_stalls) << "%)" << std::endl;
+
+        // stalls propagate upstream: output stalls cause AIE send stalls, which cause a full input buffer
+        std::string bottleneck = "none, input accepted at line rate";
+        if (percent(perf.out_stalls) > 5.0)
+                bottleneck = "DMA output stream (device-to-host)";
+        else if (percent(perf.aie_send_stalls) > 5.0)
+                bottleneck = "AIE graph";
+        else if (percent(perf.in_empty) > 5.0)
+                bottleneck = "DMA input stream (host-to-device)";
+        std::cout << "Bottleneck: " << bottleneck << std::endl;
+}
+
+void add_perf_counters(PerfCounters &acc, const PerfCounters &perf) {
+        acc.cycles += perf.cycles;
+        acc.in_beats += perf.in_beats;
+        acc.out_beats += perf.out_beats;
+        acc.in_empty += perf.in_empty;
+        acc.in_full += perf.in_full;
+        acc.aie_send_stalls += perf.aie_send_stalls;
+        acc.aie_receive_starved += perf.aie_receive_starved;
+        acc.out_stalls += perf.out_stalls;
+}
+
+#ifdef VN_REDUCE
+/**
+ * Reduction mode (PE built with MODE=reduce): compute the norm of each of 'segments' consecutive segments
+ * of 'segment_samples' samples in one launch. The PE returns the accumulated elements of each segment
+ * (e.g. the squared L2 norm), the host completes the norm.
+ */
+std::vector<float> segment_norms(tapasco::Tapasco &tap, const std::vector<input_t> &input, size_t segment_samples,
+                size_t segments, unsigned int &cycles, PerfCounters &perf) {
+        std::vector<float> accumulated(segments);
+        tapasco::PEId peId = tap.get_pe_id(PE_NAME);
+        auto inputStream = tapasco::makeInputStream(input.data(), segment_samples * segments * VN_DIM * sizeof(input_t));
+        auto outputStream = tapasco::makeOutputStream(accumulated.data(), accumulated.size() * sizeof(float));
+        tapasco::RetVal<unsigned int> ret(&cycles);
+        auto perfOut = tapasco::makeOutOnly(tapasco::makeWrappedPointer((uint8_t *)&perf, sizeof(PerfCounters)));
+
+        // arguments: samples per segment, performance counters, no packet mode, no control block, no stop, segments
+        auto task = tap.launch(peId, ret, inputStream, outputStream, segment_samples, perfOut, 0, 0, 0, segments);
+        task();
+
+        std::vector<float> norms(segments);
+        for (size_t s = 0; s < segments; ++s)
+                norms[s] = finish<VN_NORM>(accumulated[s]);
+        return norms;
+}
+#else
+/**
+ * SoA input (--soa <chunks>): the components of the samples are stored in separate arrays. They are interleaved
+ * chunk-wise into two alternating buffers, each chunk is processed by its own launch, and the next chunk is packed
+ * while the PE streams the current one, so the packing pass overlaps with the DMA transfers.
+ */
+void soa_launches(tapasco::Tapasco &tap, const std::array<const input_t *, VN_DIM> &components, size_t samples,
+                size_t chunks, output_t *output, unsigned int &cycles, PerfCounters &perf) {
+        tapasco::PEId peId = tap.get_pe_id(PE_NAME);
+        size_t chunk_samples = (samples + chunks - 1) / chunks;
+        std::array<std::vector<input_t>, 2> packed;
+        for (auto &p : packed)
+                p.resize(chunk_samples * VN_DIM);
+
+        pack_soa(components, 0, std::min(chunk_samples, samples), packed[0].data());
+        for (size_t k = 0, first = 0; first < samples; ++k, first += chunk_samples) {
+                size_t count = std::min(chunk_samples, samples - first);
+                auto inputStream = tapasco::makeInputStream(packed[k % 2].data(), count * VN_DIM * sizeof(input_t));
+                auto outputStream = tapasco::makeOutputStream(output + first, count * sizeof(output_t));
+                unsigned int chunk_cycles = 0;
+                tapasco::RetVal<unsigned int> ret(&chunk_cycles);
+                PerfCounters chunk_perf{};
+                auto perfOut = tapasco::makeOutOnly(tapasco::makeWrappedPointer((uint8_t *)&chunk_perf, sizeof(PerfCounters)));
+                auto task = tap.launch(peId, ret, inputStream, outputStream, count, perfOut, 0, 0);
+
+                // the buffer of the next chunk was used by the previous launch, which has completed
+                size_t next = first + count;
+                if (next < samples)
+                        pack_soa(components, next, std::min(chunk_samples, samples - next), packed[(k + 1) % 2].data());
+
+                task();
+                cycles += chunk_cycles;
+                add_perf_counters(perf, chunk_perf);
+        }
+}
+#endif
 
 int main(int argc, char **argv) {
 
         boost::program_options::options_description desc;
         desc.add_options()
-                ("samples", boost::program_options::value<std::size_t>()->default_value(DEFAULT_SAMPLES), "number of total samples");
+                ("samples", boost::program_options::value<std::size_t>()->default_value(DEFAULT_SAMPLES), "number of total samples (per packet in packet mode)")
+                ("packets", boost::program_options::value<std::size_t>(), "run PE in packet mode and stream the given number of packets")
+#ifdef VN_REDUCE
+                ("segments", boost::program_options::value<std::size_t>()->default_value(1), "number of segments of <samples> to compute norms of")
+#else
+                ("soa", boost::program_options::value<std::size_t>(), "store the components in separate arrays and interleave them in the given number of chunks, overlapped with the launches")
+#endif
+                ;
 
         boost::program_options::variables_map vm;
         boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
@@ -19,61 +235,172 @@ int main(int argc, char **argv) {
 
         size_t num_samples = vm["samples"].as<std::size_t>();
 
-        if (num_samples % 1024) {
-                std::cout << "ERROR: number of samples must be multiple of 1024" << std::endl;
+        // in packet mode, the PE runs until stopped and marks the end of each packet of results with 'last'
+        bool packet_mode = vm.count("packets");
+
+        // the PE pads the input to whole AIE windows and drops the results of padding, so any number of samples is supported
+        if (!num_samples || (packet_mode && (num_samples % SAMPLES_PER_RESULT_BEAT || !INPUT_BEAT_ALIGNED(num_samples)))) {
+                std::cout << "ERROR: number of samples must be non-zero";
+                if (packet_mode)
+                        std::cout << " and fill whole input and output beats (a multiple of " << SAMPLES_PER_RESULT_BEAT
+                                << " results and of 64 bytes of input) in packet mode";
+                std::cout << std::endl;
                 return -1;
         } else if (num_samples > (1UL << 32)) {
                 std::cout << "WARNING: truncating to maximum number of samples (" << (1UL << 32) << ")" <<  std::endl;
                 num_samples = 1UL << 32;
         }
+#ifdef VN_REDUCE
+        if (packet_mode) {
+                std::cout << "ERROR: packet mode is not supported in reduction mode" << std::endl;
+                return -1;
+        }
+        size_t num_packets = vm["segments"].as<std::size_t>();
+        if (!num_packets || (num_packets > 1 && !INPUT_BEAT_ALIGNED(num_samples))) {
+                std::cout << "ERROR: number of segments must be non-zero, samples per segment must fill whole input beats"
+                        << " (multiple of 64 bytes)" << std::endl;
+                return -1;
+        }
+        size_t soa_chunks = 0;
+#else
+        size_t num_packets = packet_mode ? vm["packets"].as<std::size_t>() : 1;
+        size_t soa_chunks = vm.count("soa") ? vm["soa"].as<std::size_t>() : 0;
+        if (vm.count("soa") && (!soa_chunks || packet_mode)) {
+                std::cout << "ERROR: SoA input requires a non-zero number of chunks and is not supported in packet mode" << std::endl;
+                return -1;
+        }
+#endif
+        size_t total_samples = num_samples * num_packets;
 
-        std::vector<float> input;
-        std::vector<float> output;
-        input.resize(num_samples * 2);
-        output.resize(num_samples);
+        // input is interleaved (AoS), or stored in one array per component (SoA) and interleaved before the launches
+        std::vector<input_t> input;
+        std::array<std::vector<input_t>, VN_DIM> soa;
+        if (soa_chunks) {
+                for (auto &component : soa)
+                        component.resize(total_samples);
+        } else {
+                input.resize(total_samples * VN_DIM);
+        }
+        auto element = [&](size_t i, size_t c) -> input_t & { return soa_chunks ? soa[c][i] : input[i * VN_DIM + c]; };
 
-        // populate input array
+        // populate input array, components alternate between ascending and descending values
         std::cout <<  "Populate input array" << std::endl;
-        for (size_t i = 0; i < num_samples; ++i) {
-                input[i * 2] = (float)i;
-                input[i * 2 + 1] = (float)(num_samples - i);
+        for (size_t i = 0; i < total_samples; ++i) {
+                for (size_t c = 0; c < VN_DIM; ++c)
+                        element(i, c) = to_input((float)(c % 2 ? total_samples - i : i + c));
         }
 
         // instantiate Tapasco (assume only one FPGA connected to this host)
         tapasco::Tapasco tap;
+#ifdef VN_REDUCE
+        unsigned int cycles = 0;
+        PerfCounters perf{};
+        std::cout <<  "Launch PE task" << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        auto norms = segment_norms(tap, input, num_samples, num_packets, cycles, perf);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        // check results, reference is accumulated in double precision
+        std::cout <<  "Check results" << std::endl;
+        bool error = false;
+        for (size_t s = 0; s < num_packets; ++s) {
+                double acc = 0;
+                for (size_t e = s * num_samples * VN_DIM; e < (s + 1) * num_samples * VN_DIM; ++e)
+                        acc = accumulate<VN_NORM>(acc, (double)from_input(input[e]));
+                double ref = finish<VN_NORM>(acc);
+                if (std::abs(ref - norms[s]) > ref * 1e-4) {
+                        std::cout << "ERROR: Wrong norm of segment " << s << ": ";
+                        std::cout << norms[s] << "(act) vs. " << ref << " (ref)" << std::endl;
+                        error = true;
+                }
+        }
+#else
         tapasco::PEId peId = tap.get_pe_id(PE_NAME);
+        std::vector<output_t> output;
+        output.resize(total_samples);
 
-        // define streams
-        auto inputStream = tapasco::makeInputStream(input.data(), input.size() * sizeof(float));
-        auto outputStream = tapasco::makeOutputStream(output.data(), output.size() * sizeof(float));
         unsigned int cycles = 0;
-        tapasco::RetVal<unsigned int> ret(&cycles);
-
-        // launch PE task
-        std::cout <<  "Launch PE task" << std::endl;
+        PerfCounters perf{};
         auto start = std::chrono::high_resolution_clock::now();
-        auto task = tap.launch(peId, ret, inputStream, outputStream, num_samples);
+        auto end = start;
+        if (soa_chunks) {
+                std::array<const input_t *, VN_DIM> components;
+                for (size_t c = 0; c < VN_DIM; ++c)
+                        components[c] = soa[c].data();
+                std::cout <<  "Launch PE tasks for " << soa_chunks << " SoA chunks" << std::endl;
+                soa_launches(tap, components, total_samples, soa_chunks, output.data(), cycles, perf);
+                end = std::chrono::high_resolution_clock::now();
+        } else {
+                // define streams
+                auto inputStream = tapasco::makeInputStream(input.data(), input.size() * sizeof(input_t));
+                auto outputStream = tapasco::makeOutputStream(output.data(), output.size() * sizeof(output_t));
+                tapasco::RetVal<unsigned int> ret(&cycles);
+                auto perfOut = tapasco::makeOutOnly(tapasco::makeWrappedPointer((uint8_t *)&perf, sizeof(PerfCounters)));
 
-        // wait for PE completion
-        task();
-        auto end = std::chrono::high_resolution_clock::now();
+                tapasco::DeviceAddress ctrl_addr = 0;
+                if (packet_mode) {
+                        StreamControl ctrl{};
+                        tap.alloc(ctrl_addr, sizeof(StreamControl));
+                        tap.copy_to((uint8_t *)&ctrl, ctrl_addr, sizeof(StreamControl));
+                }
+
+                // launch PE task
+                std::cout <<  "Launch PE task" << std::endl;
+                start = std::chrono::high_resolution_clock::now();
+                auto task = tap.launch(peId, ret, inputStream, outputStream, num_samples, perfOut, packet_mode ? 1 : 0, ctrl_addr);
+
+                // all packets are passed in this launch, the host follows the progress of the PE through the control block
+                if (packet_mode) {
+                        StreamControl ctrl{};
+                        auto last_progress = std::chrono::steady_clock::now();
+                        while (ctrl.packets < num_packets) {
+                                uint64_t prev = ctrl.packets;
+                                tap.copy_from(ctrl_addr, (uint8_t *)&ctrl, sizeof(StreamControl));
+                                for (uint64_t p = prev; p < ctrl.packets; ++p)
+                                        std::cout << "Packet " << p << " completed" << std::endl;
+                                auto now = std::chrono::steady_clock::now();
+                                if (ctrl.packets != prev) {
+                                        last_progress = now;
+                                } else if (now - last_progress > std::chrono::milliseconds(PACKET_TIMEOUT_MS)) {
+                                        std::cout << "ERROR: no packet completed within " << PACKET_TIMEOUT_MS << " ms, stop PE after "
+                                                << ctrl.packets << " of " << num_packets << " packets" << std::endl;
+                                        break;
+                                }
+                                std::this_thread::yield();
+                        }
+                        uint64_t stop = 1;
+                        tap.copy_to((uint8_t *)&stop, ctrl_addr + offsetof(StreamControl, stop), sizeof(uint64_t));
+                }
 
-        // check results
+                // wait for PE completion
+                task();
+                end = std::chrono::high_resolution_clock::now();
+                if (packet_mode)
+                        tap.free(ctrl_addr);
+        }
+
+        // check results, reference is computed in fp32 from the converted inputs,
+        // bf16 results are only accurate to the rounding of the output
         std::cout <<  "Check results" << std::endl;
+        const float tolerance = sizeof(output_t) == 2 ? 1.0f / 256 : 1e-5;
         bool error = false;
-        for (size_t i = 0; i < num_samples; ++i) {
-                float x = input[i * 2];
-                float y = input[i * 2 + 1];
-                float ref = std::sqrt(x * x + y * y);
+        for (size_t i = 0; i < total_samples; ++i) {
+                float components[VN_DIM];
+                for (size_t c = 0; c < VN_DIM; ++c)
+                        components[c] = from_input(element(i, c));
+                float ref = norm<VN_NORM, VN_DIM>(components);
 
-                float diff = ref - output[i];
-                if (diff > ref * 1e-5) {
+                float act = from_output(output[i]);
+                float diff = ref - act;
+                if (diff > ref * tolerance) {
                         std::cout << "ERROR: Wrong result at index " << i << ": ";
-                        std::cout << output[i] << "(act) vs. " << ref << " (ref)" << std::endl;
+                        std::cout << act << "(act) vs. " << ref << " (ref)" << std::endl;
                         error = true;
                 }
         }
 
+#endif
+
         if (error)
                 std::cout << "ERROR: Result contains false values, test run failed" << std::endl;
         else
@@ -84,6 +411,7 @@ int main(int argc, char **argv) {
         std::cout << "Host runtime: " << dur.count() << " s" << std::endl;
         double accRuntime = cycles / (tap.design_frequency() * 1e6);
         std::cout << "Accelerator runtime: " << accRuntime << " s" << std::endl;
+        print_perf_counters(perf);
 
         return 0;
 }
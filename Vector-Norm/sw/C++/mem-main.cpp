@@ -0,0 +1,192 @@
+#include <iostream>
+#include <cmath>
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <tapasco.hpp>
+
+#include "norm.hpp"
+
+#define DEFAULT_SAMPLES (1 << 24)
+#define DEFAULT_CHUNK_SAMPLES (1 << 16)
+#define DEFAULT_PES 4
+// the PE writes whole result beats of 16 samples
+#define SAMPLES_PER_RESULT_BEAT 16
+#define PE_NAME "esa.informatik.tu-darmstadt.de:user:MemStreamerVN:1.0"
+
+/**
+ * Chunks [next, end) not yet taken by a worker. The owner takes chunks from the front, idle workers steal
+ * the back half of the largest remaining range.
+ */
+struct ChunkRange {
+        std::mutex lock;
+        size_t next = 0;
+        size_t end = 0;
+};
+
+struct WorkerStats {
+        size_t chunks = 0;
+        size_t stolen_chunks = 0;
+        uint64_t cycles = 0;
+};
+
+/**
+ * Take the next chunk of worker 'self', refilling its range from another worker if it is empty
+ */
+bool next_chunk(std::vector<ChunkRange> &ranges, size_t self, bool steal, size_t &chunk, WorkerStats &stats) {
+        {
+                std::lock_guard<std::mutex> guard(ranges[self].lock);
+                if (ranges[self].next < ranges[self].end) {
+                        chunk = ranges[self].next++;
+                        return true;
+                }
+        }
+        if (!steal)
+                return false;
+
+        while (true) {
+                size_t victim = self;
+                size_t remaining = 0;
+                for (size_t w = 0; w < ranges.size(); ++w) {
+                        std::lock_guard<std::mutex> guard(ranges[w].lock);
+                        if (ranges[w].end - ranges[w].next > remaining) {
+                                victim = w;
+                                remaining = ranges[w].end - ranges[w].next;
+                        }
+                }
+                if (victim == self)
+                        return false;
+
+                // the range may have shrunk since it was inspected, retry if it was emptied
+                size_t first, last;
+                {
+                        std::lock_guard<std::mutex> guard(ranges[victim].lock);
+                        if (ranges[victim].next == ranges[victim].end)
+                                continue;
+                        first = ranges[victim].next + (ranges[victim].end - ranges[victim].next) / 2;
+                        last = ranges[victim].end;
+                        ranges[victim].end = first;
+                }
+                std::lock_guard<std::mutex> guard(ranges[self].lock);
+                ranges[self].next = first + 1;
+                ranges[self].end = last;
+                chunk = first;
+                stats.stolen_chunks += last - first;
+                return true;
+        }
+}
+
+int main(int argc, char **argv) {
+
+        boost::program_options::options_description desc;
+        desc.add_options()
+                ("samples", boost::program_options::value<std::size_t>()->default_value(DEFAULT_SAMPLES), "number of total samples")
+                ("chunk-samples", boost::program_options::value<std::size_t>()->default_value(DEFAULT_CHUNK_SAMPLES), "number of samples per launch")
+                ("pes", boost::program_options::value<std::size_t>()->default_value(DEFAULT_PES), "number of composed PEs, one worker thread each")
+                ("no-steal", "only process the initial equal share of chunks on each PE");
+
+        boost::program_options::variables_map vm;
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+        boost::program_options::notify(vm);
+
+        size_t num_samples = vm["samples"].as<std::size_t>();
+        size_t chunk_samples = vm["chunk-samples"].as<std::size_t>();
+        size_t num_pes = vm["pes"].as<std::size_t>();
+        bool steal = !vm.count("no-steal");
+
+        if (!num_samples || num_samples % SAMPLES_PER_RESULT_BEAT || !chunk_samples || chunk_samples % SAMPLES_PER_RESULT_BEAT) {
+                std::cout << "ERROR: number of samples and samples per chunk must be non-zero multiples of " << SAMPLES_PER_RESULT_BEAT << std::endl;
+                return -1;
+        }
+        if (!num_pes) {
+                std::cout << "ERROR: number of PEs must be non-zero" << std::endl;
+                return -1;
+        }
+
+        std::vector<float> input;
+        std::vector<float> output;
+        input.resize(num_samples * 2);
+        output.resize(num_samples);
+
+        // populate input array
+        std::cout <<  "Populate input array" << std::endl;
+        for (size_t i = 0; i < num_samples; ++i) {
+                input[i * 2] = (float)i;
+                input[i * 2 + 1] = (float)(num_samples - i);
+        }
+
+        // instantiate Tapasco (assume only one FPGA connected to this host)
+        tapasco::Tapasco tap;
+        tapasco::PEId peId = tap.get_pe_id(PE_NAME);
+
+        // each worker starts with an equal share of the chunks
+        size_t num_chunks = (num_samples + chunk_samples - 1) / chunk_samples;
+        std::vector<ChunkRange> ranges(num_pes);
+        for (size_t w = 0; w < num_pes; ++w) {
+                ranges[w].next = num_chunks * w / num_pes;
+                ranges[w].end = num_chunks * (w + 1) / num_pes;
+        }
+
+        // one worker per PE: a launch occupies a free PE until completion, so the workers keep all PEs busy.
+        // Input and results are copied to and from on-board memory by the runtime for each launch.
+        std::vector<WorkerStats> stats(num_pes);
+        auto worker = [&](size_t self) {
+                size_t chunk;
+                while (next_chunk(ranges, self, steal, chunk, stats[self])) {
+                        size_t first = chunk * chunk_samples;
+                        size_t count = std::min(chunk_samples, num_samples - first);
+                        auto inBuf = tapasco::makeInOnly(tapasco::makeWrappedPointer((uint8_t *)&input[first * 2], count * 2 * sizeof(float)));
+                        auto outBuf = tapasco::makeOutOnly(tapasco::makeWrappedPointer((uint8_t *)&output[first], count * sizeof(float)));
+                        unsigned int cycles = 0;
+                        tapasco::RetVal<unsigned int> ret(&cycles);
+                        auto task = tap.launch(peId, ret, inBuf, count, outBuf);
+                        task();
+                        stats[self].chunks++;
+                        stats[self].cycles += cycles;
+                }
+        };
+
+        std::cout <<  "Launch PE tasks on " << num_pes << " PEs" << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t w = 0; w < num_pes; ++w)
+                workers.emplace_back(worker, w);
+        for (auto &t : workers)
+                t.join();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        // check results
+        std::cout <<  "Check results" << std::endl;
+        bool error = false;
+        for (size_t i = 0; i < num_samples; ++i) {
+                float ref = norm<VN_NORM, 2>(&input[i * 2]);
+
+                float diff = ref - output[i];
+                if (diff > ref * 1e-5) {
+                        std::cout << "ERROR: Wrong result at index " << i << ": ";
+                        std::cout << output[i] << "(act) vs. " << ref << " (ref)" << std::endl;
+                        error = true;
+                }
+        }
+
+        if (error)
+                std::cout << "ERROR: Result contains false values, test run failed" << std::endl;
+        else
+                std::cout << "SUCCESS: Test run completed without errors" << std::endl;
+
+        // print runtimes, the aggregate throughput includes the transfers between host and on-board memory
+        std::chrono::duration<double> dur = end - start;
+        std::cout << "Host runtime: " << dur.count() << " s" << std::endl;
+        double gbytes = (input.size() * sizeof(float)) / 1e9;
+        std::cout << "Aggregate input throughput: " << gbytes / dur.count() << " GB/s" << std::endl;
+        for (size_t w = 0; w < num_pes; ++w) {
+                double accRuntime = stats[w].cycles / (tap.design_frequency() * 1e6);
+                std::cout << "Worker " << w << ": " << stats[w].chunks << " chunks (" << stats[w].stolen_chunks
+                        << " stolen), accelerator runtime " << accRuntime << " s" << std::endl;
+        }
+
+        return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "norm_type.h"
+
+/**
+ * Reference norms with the same norm type and dimension as the AIE graph (NORM and DIM, see CMakeLists.txt).
+ * Components are folded with accumulate() and the result is completed with finish(). In reduction mode, the PE
+ * folds all elements of a segment the same way and the host only applies finish().
+ */
+template <NormType N, typename T>
+T accumulate(T acc, T v) {
+        if constexpr (N == NORM_LINF)
+                return std::max(acc, std::abs(v));
+        else if constexpr (N == NORM_L1)
+                return acc + std::abs(v);
+        else
+                return acc + v * v;
+}
+
+template <NormType N, typename T>
+T finish(T acc) {
+        if constexpr (N == NORM_L2)
+                return std::sqrt(acc);
+        else
+                return acc;
+}
+
+template <NormType N, std::size_t D, typename T>
+T norm(const T *components) {
+        T acc = 0;
+        for (std::size_t c = 0; c < D; ++c)
+                acc = accumulate<N>(acc, components[c]);
+        return finish<N>(acc);
+}
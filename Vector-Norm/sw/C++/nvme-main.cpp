@@ -0,0 +1,204 @@
+#include <iostream>
+#include <cmath>
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <tapasco.hpp>
+#include <tapasco-nvme.hpp>
+#include <nvme-device-ioctl.h>
+
+#include "norm.hpp"
+
+#define DEFAULT_SAMPLES 16384
+// samples are distributed over AIE_LANES pipelines of the AIE graph, each processing windows of WINDOW_SIZE samples
+#ifndef AIE_LANES
+#define AIE_LANES 2
+#endif
+#define WINDOW_SIZE 1024
+#define PE_NAME "esa.informatik.tu-darmstadt.de:user:NVMeStreamerVN:1.0"
+
+/**
+ * Make NVMe controller accessible for the PE by setting up an IO queue for the FPGA
+ */
+bool setup_nvme(tapasco::Tapasco &tap, int nvme_fd, bool reset_io_queue) {
+        auto nvme_plugin = tap.get_plugin<tapasco::TapascoNvmePlugin>();
+        if (!nvme_plugin.is_available()) {
+                std::cout << "ERROR: NVMe plugin not available" << std::endl;
+                return false;
+        }
+        auto [sq_addr, cq_addr] = nvme_plugin.get_queue_base_addr();
+
+        size_t nvme_pcie_addr = 0;
+        if (ioctl(nvme_fd, NVME_GET_PCIE_BASE, &nvme_pcie_addr) || !nvme_pcie_addr) {
+                std::cout << "ERROR: Unable to get PCIe base address of NVMe controller" << std::endl;
+                return false;
+        }
+
+        // only required if bitstream has been reloaded
+        if (reset_io_queue) {
+                struct ioctl_release_io_queue_cmd release_io_queue_cmd = {0};
+                if (ioctl(nvme_fd, NVME_RELEASE_IO_QUEUE, &release_io_queue_cmd)
+                        || release_io_queue_cmd.status == RELEASE_IO_QUEUE_FAILED) {
+                        std::cout << "ERROR: Unable to release IO queue for FPGA" << std::endl;
+                        return false;
+                }
+        }
+
+        struct ioctl_setup_io_queue_cmd setup_queue_cmd = {0};
+        setup_queue_cmd.sq_addr = sq_addr;
+        setup_queue_cmd.cq_addr = cq_addr;
+        if (ioctl(nvme_fd, NVME_SETUP_IO_QUEUE, &setup_queue_cmd) || setup_queue_cmd.status == CREATE_IO_QUEUE_FAILED) {
+                std::cout << "ERROR: IO queue creation failed" << std::endl;
+                return false;
+        }
+        if (setup_queue_cmd.status == CREATE_IO_QUEUE_PRESENT) {
+                std::cout << "WARNING: IO queue already set up, use --reset-io-queue after reloading the bitstream" << std::endl;
+        }
+
+        nvme_plugin.set_nvme_pcie_addr(nvme_pcie_addr);
+        nvme_plugin.enable();
+        return true;
+}
+
+/**
+ * Read or write host buffer from/to NVMe using the host driver
+ */
+bool nvme_transfer(int nvme_fd, bool write, uint64_t nvme_addr, void *buf, size_t len) {
+        struct ioctl_nvme_cmd cmd = {0};
+        cmd.nvme_addr = nvme_addr;
+        cmd.len = len;
+        cmd.buf = buf;
+        if (ioctl(nvme_fd, write ? NVME_WRITE : NVME_READ, &cmd) || cmd.status) {
+                std::cout << "ERROR: NVMe " << (write ? "write" : "read") << " at address 0x" << std::hex << nvme_addr
+                        << std::dec << " failed" << std::endl;
+                return false;
+        }
+        return true;
+}
+
+int main(int argc, char **argv) {
+
+        boost::program_options::options_description desc;
+        desc.add_options()
+                ("samples", boost::program_options::value<std::size_t>()->default_value(DEFAULT_SAMPLES), "number of total samples")
+                ("nvme-in-addr", boost::program_options::value<std::size_t>()->default_value(0), "NVMe address of input")
+                ("nvme-out-addr", boost::program_options::value<std::size_t>(), "NVMe address of results (default: on-board DRAM)")
+                ("skip-write-input", "input is already present on NVMe device")
+                ("reset-io-queue", "reset IO queue for FPGA in NVMe controller");
+
+        boost::program_options::variables_map vm;
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+        boost::program_options::notify(vm);
+
+        size_t num_samples = vm["samples"].as<std::size_t>();
+        size_t nvme_in_addr = vm["nvme-in-addr"].as<std::size_t>();
+        bool out_to_nvme = vm.count("nvme-out-addr");
+
+        if (num_samples % (WINDOW_SIZE * AIE_LANES)) {
+                std::cout << "ERROR: number of samples must be multiple of " << WINDOW_SIZE * AIE_LANES << std::endl;
+                return -1;
+        }
+        if (nvme_in_addr % 512 || (out_to_nvme && vm["nvme-out-addr"].as<std::size_t>() % 512)) {
+                std::cout << "ERROR: NVMe addresses must be aligned to 512 bytes" << std::endl;
+                return -1;
+        }
+
+        std::vector<float> input;
+        std::vector<float> output;
+        input.resize(num_samples * 2);
+        output.resize(num_samples);
+
+        // populate input array
+        std::cout <<  "Populate input array" << std::endl;
+        for (size_t i = 0; i < num_samples; ++i) {
+                input[i * 2] = (float)i;
+                input[i * 2 + 1] = (float)(num_samples - i);
+        }
+
+        // instantiate Tapasco (assume only one FPGA connected to this host)
+        tapasco::Tapasco tap;
+        tapasco::PEId peId = tap.get_pe_id(PE_NAME);
+
+        int nvme_fd = open("/dev/nvme-host-driver", O_RDWR);
+        if (nvme_fd < 0) {
+                std::cout << "ERROR: Unable to open NVMe host driver" << std::endl;
+                return 1;
+        }
+        if (!setup_nvme(tap, nvme_fd, vm.count("reset-io-queue"))) {
+                close(nvme_fd);
+                return 1;
+        }
+
+        // input is placed on the NVMe device once, afterwards it never passes host memory
+        if (!vm.count("skip-write-input")) {
+                std::cout << "Write input to NVMe device" << std::endl;
+                if (!nvme_transfer(nvme_fd, true, nvme_in_addr, input.data(), input.size() * sizeof(float))) {
+                        close(nvme_fd);
+                        return 1;
+                }
+        }
+
+        // results go to on-board DRAM or back to the NVMe device
+        tapasco::DeviceAddress out_addr = 0;
+        if (out_to_nvme)
+                out_addr = vm["nvme-out-addr"].as<std::size_t>();
+        else
+                tap.alloc(out_addr, output.size() * sizeof(float));
+
+        unsigned int cycles = 0;
+        tapasco::RetVal<unsigned int> ret(&cycles);
+
+        // launch PE task
+        std::cout <<  "Launch PE task" << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        auto task = tap.launch(peId, ret, nvme_in_addr, num_samples, out_addr, out_to_nvme ? 1 : 0);
+
+        // wait for PE completion
+        task();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        // fetch results
+        if (out_to_nvme) {
+                if (!nvme_transfer(nvme_fd, false, out_addr, output.data(), output.size() * sizeof(float))) {
+                        close(nvme_fd);
+                        return 1;
+                }
+        } else {
+                tap.copy_from(out_addr, (uint8_t *)output.data(), output.size() * sizeof(float));
+                tap.free(out_addr);
+        }
+        close(nvme_fd);
+
+        // check results
+        std::cout <<  "Check results" << std::endl;
+        bool error = false;
+        for (size_t i = 0; i < num_samples; ++i) {
+                float ref = norm<VN_NORM, 2>(&input[i * 2]);
+
+                float diff = ref - output[i];
+                if (diff > ref * 1e-5) {
+                        std::cout << "ERROR: Wrong result at index " << i << ": ";
+                        std::cout << output[i] << "(act) vs. " << ref << " (ref)" << std::endl;
+                        error = true;
+                }
+        }
+
+        if (error)
+                std::cout << "ERROR: Result contains false values, test run failed" << std::endl;
+        else
+                std::cout << "SUCCESS: Test run completed without errors" << std::endl;
+
+        // print runtimes
+        std::chrono::duration<double> dur = end - start;
+        std::cout << "Host runtime: " << dur.count() << " s" << std::endl;
+        double accRuntime = cycles / (tap.design_frequency() * 1e6);
+        std::cout << "Accelerator runtime: " << accRuntime << " s" << std::endl;
+        double gbytes = (input.size() * sizeof(float)) / 1e9;
+        std::cout << "NVMe input throughput: " << gbytes / accRuntime << " GB/s" << std::endl;
+
+        return 0;
+}
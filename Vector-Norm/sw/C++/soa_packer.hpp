@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/**
+ * Interleave 'count' samples starting at sample 'first' of D component arrays (SoA) into 'out' (AoS), i.e.
+ * component c of sample first + i is written to out[i * D + c]. Two fp32 components are interleaved with
+ * SIMD unpack instructions (8 samples per iteration with AVX, 4 with SSE), all other cases and the
+ * remaining samples with a plain loop.
+ */
+template <std::size_t D, typename T>
+void pack_soa(const std::array<const T *, D> &components, std::size_t first, std::size_t count, T *out) {
+        std::size_t i = 0;
+#if defined(__AVX__) || defined(__SSE__)
+        if constexpr (D == 2 && std::is_same_v<T, float>) {
+                const float *x = components[0] + first;
+                const float *y = components[1] + first;
+#if defined(__AVX__)
+                for (; i + 8 <= count; i += 8) {
+                        __m256 vx = _mm256_loadu_ps(x + i);
+                        __m256 vy = _mm256_loadu_ps(y + i);
+                        // x0 y0 x1 y1 | x4 y4 x5 y5 and x2 y2 x3 y3 | x6 y6 x7 y7
+                        __m256 lo = _mm256_unpacklo_ps(vx, vy);
+                        __m256 hi = _mm256_unpackhi_ps(vx, vy);
+                        _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+                        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+                }
+#else
+                for (; i + 4 <= count; i += 4) {
+                        __m128 vx = _mm_loadu_ps(x + i);
+                        __m128 vy = _mm_loadu_ps(y + i);
+                        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(vx, vy));
+                        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(vx, vy));
+                }
+#endif
+        }
+#endif
+        for (; i < count; ++i)
+                for (std::size_t c = 0; c < D; ++c)
+                        out[i * D + c] = components[c][first + i];
+}
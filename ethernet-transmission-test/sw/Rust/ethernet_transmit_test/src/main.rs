@@ -6,14 +6,42 @@ extern crate tapasco;
 use std::collections::HashMap;
 use std::io;
 use std::mem::size_of;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
 use snafu::{ResultExt, Snafu};
-use tapasco::device::{DataTransferAlloc, PEParameter};
+use tapasco::device::{DataTransferAlloc, OffchipMemory, PEParameter};
+use tapasco::job::Job;
 use tapasco::tlkm::TLKM;
 use structopt::StructOpt;
 
 const RECEIVER_PE_NAME: &str = "esa.informatik.tu-darmstadt.de:user:EthernetReceiver:1.0";
 const TRANSMITTER_PE_NAME: &str = "esa.informatik.tu-darmstadt.de:user:EthernetTransmitter:1.0";
-const OUTPUT_BUFFER_SIZE: usize = 4 * 1024 * 1024 * 1024; // 4 GB
+// ring-buffer mode: control block in device memory, polled and updated by the receiver PE
+const RING_CTRL_SIZE: usize = 64;
+const RING_CTRL_STOP: u64 = 0;
+const RING_CTRL_CONSUMED: u64 = 8;
+const RING_CTRL_COMPLETED: u64 = 16;
+// the host stops the receiver when no data has arrived in the ring for this long, data lost on the way never arrives
+const RING_IDLE_TIMEOUT: Duration = Duration::from_secs(1);
+// frame statistics written by the receiver PE at the end of a run: tracked, lost and reordered frames,
+// latency of the first frame, minimum and maximum latency, bucket shift, sent PAUSE frames (words 0 to 7),
+// latency histogram (words 8 to 23), write pointers of the receive queues (words 24 to 27)
+const STATS_SIZE: usize = 256;
+const STATS_HISTOGRAM: usize = 8;
+const STATS_BUCKETS: usize = 16;
+const STATS_QUEUE_OFFSETS: usize = 24;
+// multi-queue receive: frames are steered on a 16-bit payload word through the steering table of the receiver PE
+const RX_QUEUES: usize = 4;
+const STEER_ENTRIES: usize = 8;
+const STEER_MODE_PAYLOAD_WORD: u64 = 2;
+const STEER_ENTRY_VALID: u64 = 1 << 18;
+// the steering word is one of the 25 16-bit words in the first 50 payload bytes
+const MAX_STEER_WORD: usize = 24;
+// gap register of the transmitter PE is 16 bits wide, frame length register 14 bits
+const MAX_GAP_CYCLES: u64 = u16::MAX as u64;
+const MAX_FRAME_LENGTH: usize = 16383;
+// with flow control, the receive buffer of the receiver PE holds a frame, its header and the beats in flight
+const PAUSE_SLACK_BEATS: usize = 64;
 
 #[derive(Debug, Snafu)]
 pub enum Error {
@@ -28,6 +56,12 @@ pub enum Error {
 
     #[snafu(display("Error while opening file: {}", source))]
     FileOpen { source: io::Error },
+
+    #[snafu(display("Failed to allocate device memory: {}", source))]
+    Allocation { source: tapasco::allocator::Error },
+
+    #[snafu(display("Failed to transfer data from/to device memory: {}", source))]
+    Transfer { source: tapasco::dma::Error },
 }
 
 #[derive(StructOpt, Debug)]
@@ -38,9 +72,12 @@ struct ProgramOptions {
     #[structopt(short, long, help = "Frame length in bytes", default_value = "8192")]
     frame_length: usize,
 
-    #[structopt(short, long, help = "Runtime of receiver in seconds", default_value = "0.5")]
+    #[structopt(short, long, help = "Runtime of receiver in seconds (ring-buffer mode: 0 = until all input is received)", default_value = "0.5")]
     runtime: f64,
 
+    #[structopt(long, help = "Size of receive ring buffer in bytes, drained by the host while receiving (0 = linear buffer)", default_value = "0")]
+    ring_size: usize,
+
     #[structopt(long, help = "MAC address of transmitter device", default_value = "399482290434")] // 399482290434 = 0x005D03000102
     src_mac: u64,
 
@@ -49,23 +86,479 @@ struct ProgramOptions {
 
     #[structopt(long, help = "Gap between transmitting frames in transmitter PE in cycles", default_value = "0")]
     gap_cycles: u64,
+
+    #[structopt(long, help = "Width of latency histogram buckets as power of two cycles", default_value = "4")]
+    latency_shift: u64,
+
+    #[structopt(long, help = "Let the receiver pause the transmitter with PAUSE frames when its buffer fills up")]
+    flow_control: bool,
+
+    #[structopt(long, help = "Receive buffer depth of the receiver PE in beats (RX_BUFFER_DEPTH of the IP)", default_value = "256")]
+    rx_buffer_depth: usize,
+
+    #[structopt(long, help = "Number of receive queues, frames are steered by a flow ID in their first payload word (linear buffer only)", default_value = "1")]
+    queues: usize,
+
+    #[structopt(long, help = "16-bit payload word carrying the flow ID with multiple queues", default_value = "0")]
+    steer_word: usize,
+
+    #[structopt(long, help = "Search the smallest lossless gap and the resulting throughput for each search frame length")]
+    search: bool,
+
+    #[structopt(long, help = "Frame lengths in bytes for the search", default_value = "1024,2048,4096,8192", use_delimiter = true)]
+    search_frame_lengths: Vec<usize>,
 }
 
 pub type Result<T, E = Error> = std::result::Result<T, E>;
 
+/// Compares received 32-bit words with their index in the transmitted data, starting at word `first_index`
+fn check_words(data: &[u8], first_index: u64, false_value_count: &mut u64, first_wrong_index: &mut Option<u64>) {
+    for (i, w) in data.chunks_exact(size_of::<u32>()).enumerate() {
+        let idx = first_index + i as u64;
+        if u32::from_le_bytes(w.try_into().unwrap()) != idx as u32 {
+            *false_value_count += 1;
+            if first_wrong_index.is_none() {
+                *first_wrong_index = Some(idx);
+            }
+        }
+    }
+}
+
+/// Compares the data received in one queue with the transmitted frames steered to it
+fn check_queue(data: &[u8], input: &[u8], frame_length: usize, queues: usize, queue: usize,
+               false_value_count: &mut u64, first_wrong_index: &mut Option<u64>) {
+    let frames = input.chunks_exact(frame_length).enumerate().skip(queue).step_by(queues);
+    for (received, (frame, expected)) in data.chunks(frame_length).zip(frames) {
+        let words = received.chunks_exact(size_of::<u32>()).zip(expected.chunks_exact(size_of::<u32>()));
+        for (i, (r, e)) in words.enumerate() {
+            if r != e {
+                *false_value_count += 1;
+                if first_wrong_index.is_none() {
+                    *first_wrong_index = Some(((frame * frame_length) / size_of::<u32>() + i) as u64);
+                }
+            }
+        }
+    }
+}
+
+/// Received data in ring-buffer mode, copied to the host and checked region by region
+struct RingDrain {
+    mem: Arc<OffchipMemory>,
+    ring: u64,
+    ring_size: usize,
+    ctrl: u64,
+    consumed: u64,
+    buffer: Box<[u8]>,
+    false_value_count: u64,
+    first_wrong_index: Option<u64>,
+}
+
+impl RingDrain {
+    fn read_ctrl(&self, offset: u64) -> Result<u64> {
+        let mut word = [0u8; 8];
+        self.mem.dma().copy_from(self.ctrl + offset, &mut word).context(TransferSnafu {})?;
+        Ok(u64::from_le_bytes(word))
+    }
+
+    fn write_ctrl(&self, offset: u64, value: u64) -> Result<()> {
+        self.mem.dma().copy_to(&value.to_le_bytes(), self.ctrl + offset).context(TransferSnafu {})
+    }
+
+    /// Copies all regions completed by the receiver since the last call and hands them back to the receiver
+    fn drain(&mut self) -> Result<()> {
+        let completed = self.read_ctrl(RING_CTRL_COMPLETED)?;
+        while self.consumed < completed {
+            let offset = (self.consumed % self.ring_size as u64) as usize;
+            let len = std::cmp::min((completed - self.consumed) as usize, self.ring_size - offset);
+            self.mem.dma().copy_from(self.ring + offset as u64, &mut self.buffer[..len]).context(TransferSnafu {})?;
+            check_words(&self.buffer[..len], self.consumed / size_of::<u32>() as u64,
+                &mut self.false_value_count, &mut self.first_wrong_index);
+            self.consumed += len as u64;
+        }
+        self.write_ctrl(RING_CTRL_CONSUMED, self.consumed)
+    }
+}
+
+/// PEs and device memories of both devices, kept for all runs
+struct TestSetup {
+    receiver_pe: Job,
+    transmitter_pe: Job,
+    receiver_mem: Arc<OffchipMemory>,
+    transmitter_mem: Arc<OffchipMemory>,
+    receiver_freq: f64,
+    transmitter_freq: f64,
+    input: Box<[u8]>,
+}
+
+/// Outcome of one run of transmitter and receiver
+struct RunResult {
+    received_beat_count: u64,
+    wrong_header_count: u64,
+    wrong_frame_len_count: u64,
+    drop_beat_error: bool,
+    frame_len_error: bool,
+    false_value_count: u64,
+    first_wrong_index: Option<u64>,
+    stats: Vec<u64>,
+    transmit_cycles: u64,
+}
+
+impl RunResult {
+    /// Whole input received correctly, without dropped beats, lost or reordered frames
+    fn lossless(&self, input_size: usize) -> bool {
+        self.received_beat_count == (input_size / 64) as u64 && self.wrong_header_count == 0
+            && self.wrong_frame_len_count == 0 && !self.drop_beat_error && !self.frame_len_error && self.false_value_count == 0
+            && self.stats[1] == 0 && self.stats[2] == 0
+    }
+
+    /// Payload throughput of the transmitter in Gbit/s
+    fn throughput(&self, input_size: usize, freq_mhz: f64) -> f64 {
+        input_size as f64 * 8.0 / (self.transmit_cycles as f64 / (freq_mhz * 1e6)) / 1e9
+    }
+
+    fn report(&self, input_size: usize, frame_length: usize) {
+        if self.frame_len_error {
+            error!("Receiver rejected the frame length, frames do not fit into its buffer with flow control");
+        }
+        if self.received_beat_count != (input_size as u64 / 64) {
+            error!("Received wrong number of beats ({} Byte vs. {} Byte", self.received_beat_count * 64, input_size);
+        }
+        if self.wrong_header_count != 0 {
+            error!("Received {} wrong headers", self.wrong_header_count);
+        }
+        if self.wrong_frame_len_count != 0 {
+            error!("Received {} frames with wrong length", self.wrong_frame_len_count);
+        }
+        if self.drop_beat_error {
+            error!("Beats have been dropped due to backpressure from memory on receiving device...consider to increase gap_cycle parameter to reduce transmit rate");
+        }
+
+        if let Some(idx) = self.first_wrong_index {
+            error!("Encountered {} wrong values", self.false_value_count);
+            let frame = idx * 4 / frame_length as u64;
+            let beat = ((idx * 4) % frame_length as u64) / 64;
+            error!("First wrong value in frame {} at beat {}", frame, beat);
+        }
+
+        let stats = &self.stats;
+        info!("Received {} frames with sequence numbers", stats[0]);
+        if stats[1] != 0 {
+            error!("Lost {} frames", stats[1]);
+        }
+        if stats[2] != 0 {
+            error!("Received {} frames out of order", stats[2]);
+        }
+        if stats[7] != 0 {
+            info!("Receiver sent {} PAUSE frames", stats[7]);
+        }
+        if stats[0] != 0 {
+            // both PEs count cycles from their own start, absolute latencies include the offset between both starts
+            info!("Latency in cycles: first frame {}, minimum {}, maximum {} (including start offset of PEs)",
+                stats[3] as i64, stats[4] as i64, stats[5] as i64);
+            let bucket_cycles = 1u64 << stats[6];
+            info!("Latency relative to first frame:");
+            for b in 0..STATS_BUCKETS {
+                let frames = stats[STATS_HISTOGRAM + b];
+                if b == STATS_BUCKETS - 1 {
+                    info!("  >= {:6} cycles: {}", b as u64 * bucket_cycles, frames);
+                }
+                else {
+                    info!("  <  {:6} cycles: {}", (b as u64 + 1) * bucket_cycles, frames);
+                }
+            }
+        }
+    }
+}
+
+/// Transmits the whole input once and checks the received data. With `release_pe`, both PEs are returned
+/// to the runtime afterwards, otherwise they stay acquired for further runs.
+fn run(setup: &mut TestSetup, options: &ProgramOptions, frame_length: usize, gap_cycles: u64, release_pe: bool) -> Result<RunResult> {
+    let ring_mode = options.ring_size != 0;
+
+    // frame k carries flow ID k % queues in the steering word and is received in the queue of the same number
+    let mut input = setup.input.clone();
+    if options.queues > 1 {
+        let offset = options.steer_word * size_of::<u16>();
+        for (k, frame) in input.chunks_exact_mut(frame_length).enumerate() {
+            frame[offset..offset + size_of::<u16>()].copy_from_slice(&((k % options.queues) as u16).to_le_bytes());
+        }
+    }
+
+    // linear mode: the whole capture is copied back after the run,
+    // ring-buffer mode: ring and control block stay allocated and are drained during the run
+    let receiver_mem = setup.receiver_mem.clone();
+    let mut receiver_params = Vec::new();
+    let mut ring_drain = None;
+    if ring_mode {
+        let (ring, ctrl) = {
+            let mut allocator = receiver_mem.allocator().lock().unwrap();
+            let ring = allocator.allocate(options.ring_size as u64, None).context(AllocationSnafu {})?;
+            let ctrl = allocator.allocate(RING_CTRL_SIZE as u64, None).context(AllocationSnafu {})?;
+            (ring, ctrl)
+        };
+        receiver_mem.dma().copy_to(&[0u8; RING_CTRL_SIZE], ctrl).context(TransferSnafu {})?;
+        receiver_params.push(PEParameter::DeviceAddress(ring));
+        ring_drain = Some(RingDrain {
+            mem: receiver_mem.clone(),
+            ring,
+            ring_size: options.ring_size,
+            ctrl,
+            consumed: 0,
+            buffer: vec![0u8; options.ring_size].into_boxed_slice(),
+            false_value_count: 0,
+            first_wrong_index: None,
+        });
+    }
+    else {
+        // the receiver only writes data of frames addressed to it up to the limit of the buffer, the input size
+        let output = vec![0u8; options.input_size].into_boxed_slice();
+        receiver_params.push(PEParameter::DataTransferAlloc(DataTransferAlloc {
+            data: output,
+            from_device: true,
+            to_device: false,
+            free: true,
+            memory: receiver_mem.clone(),
+            fixed: None,
+        }));
+    }
+    let mut run_cycles: u64 = (options.runtime * setup.receiver_freq * 1e6) as u64;
+    info!("Runtime: {}, Device Frequency: {}", options.runtime, setup.receiver_freq);
+    if ring_mode {
+        // the host stops the receiver through the control block
+        run_cycles = 0;
+        info!("Run receiver PE until stopped");
+    }
+    else {
+        info!("Run receiver PE for {} cycles", run_cycles);
+    }
+    if run_cycles > u32::MAX as u64 {
+        warn!("Use maximum run cycles for receiver PE");
+        run_cycles = u32::MAX as u64;
+    }
+    receiver_params.push(PEParameter::Single64(run_cycles));
+    receiver_params.push(PEParameter::Single64(frame_length as u64));
+    receiver_params.push(PEParameter::Single64(options.src_mac));
+    receiver_params.push(PEParameter::Single64(options.dst_mac));
+    receiver_params.push(PEParameter::Single64(0xACAC));
+    receiver_params.push(PEParameter::Single64(options.ring_size as u64));
+    receiver_params.push(PEParameter::DeviceAddress(ring_drain.as_ref().map_or(0, |d| d.ctrl)));
+    receiver_params.push(PEParameter::Single64(options.latency_shift));
+    receiver_params.push(PEParameter::DataTransferAlloc(DataTransferAlloc {
+        data: vec![0u8; STATS_SIZE].into_boxed_slice(),
+        from_device: true,
+        to_device: false,
+        free: true,
+        memory: receiver_mem.clone(),
+        fixed: None,
+    }));
+    receiver_params.push(PEParameter::Single64(options.flow_control as u64));
+    receiver_params.push(PEParameter::Single64(if options.queues > 1 { STEER_MODE_PAYLOAD_WORD } else { 0 }));
+    receiver_params.push(PEParameter::Single64(options.steer_word as u64));
+    // queue 0 uses the output buffer, the other queues get buffers for their share of the frames
+    let frame_count = options.input_size / frame_length;
+    let mut queue_sizes = vec![0; RX_QUEUES];
+    queue_sizes[0] = if ring_mode { 0 } else { options.input_size };
+    for q in 1..RX_QUEUES {
+        if q < options.queues {
+            let queue_frames = (frame_count + options.queues - 1 - q) / options.queues;
+            queue_sizes[q] = std::cmp::max(queue_frames * frame_length, 64);
+            receiver_params.push(PEParameter::DataTransferAlloc(DataTransferAlloc {
+                data: vec![0u8; queue_sizes[q]].into_boxed_slice(),
+                from_device: true,
+                to_device: false,
+                free: true,
+                memory: receiver_mem.clone(),
+                fixed: None,
+            }));
+        }
+        else {
+            receiver_params.push(PEParameter::DeviceAddress(0));
+        }
+    }
+    for e in 0..STEER_ENTRIES {
+        let entry = if e < options.queues && options.queues > 1 { STEER_ENTRY_VALID | ((e as u64) << 16) | e as u64 } else { 0 };
+        receiver_params.push(PEParameter::Single64(entry));
+    }
+    // the receiver discards beats beyond the end of the buffer of their queue
+    for &size in &queue_sizes {
+        receiver_params.push(PEParameter::Single64(size as u64));
+    }
+
+    let mut transmitter_params = Vec::new();
+    transmitter_params.push(PEParameter::DataTransferAlloc(DataTransferAlloc {
+        data: input.clone(),
+        from_device: false,
+        to_device: true,
+        free: true,
+        memory: setup.transmitter_mem.clone(),
+        fixed: None,
+    }));
+    transmitter_params.push(PEParameter::Single64(options.input_size as u64));
+    transmitter_params.push(PEParameter::Single64(frame_length as u64));
+    transmitter_params.push(PEParameter::Single64(gap_cycles));
+    transmitter_params.push(PEParameter::Single64(options.src_mac));
+    transmitter_params.push(PEParameter::Single64(options.dst_mac));
+    transmitter_params.push(PEParameter::Single64(0xACAC));
+
+    info!("Launch PEs");
+    setup.receiver_pe.start(receiver_params).context(JobSnafu {})?;
+    setup.transmitter_pe.start(transmitter_params).context(JobSnafu {})?;
+
+    // drain the ring until all input has been received, the runtime has passed or no data has arrived for
+    // RING_IDLE_TIMEOUT, then stop the receiver
+    if let Some(drain) = ring_drain.as_mut() {
+        let start = Instant::now();
+        let mut last_progress = Instant::now();
+        while drain.consumed < options.input_size as u64
+                && (options.runtime == 0.0 || start.elapsed().as_secs_f64() < options.runtime) {
+            let consumed = drain.consumed;
+            drain.drain()?;
+            if drain.consumed != consumed {
+                last_progress = Instant::now();
+            }
+            else if last_progress.elapsed() >= RING_IDLE_TIMEOUT {
+                error!("No data received for {} s, stop receiver {} Byte short of the input",
+                    RING_IDLE_TIMEOUT.as_secs(), options.input_size as u64 - drain.consumed);
+                break;
+            }
+            std::thread::sleep(Duration::from_micros(100));
+        }
+        drain.write_ctrl(RING_CTRL_STOP, 1)?;
+    }
+
+    // the transmitter returns the number of cycles from its start until the last frame has been sent
+    let (transmit_cycles, _o) = setup.transmitter_pe.release(release_pe, true).context(JobSnafu {})?;
+    info!("Transmitter PE released");
+    let (result, out_vec) = setup.receiver_pe.release(release_pe, true).context(JobSnafu {})?;
+    info!("Receiver PE released");
+
+    let received_beat_count = result & 0xFFFFFFFF;
+    let mut false_value_count = 0;
+    let mut first_wrong_index = None;
+    if let Some(mut drain) = ring_drain {
+        // the receiver publishes its final byte count before the interrupt
+        drain.drain()?;
+        info!("Drained {} bytes from ring buffer", drain.consumed);
+        false_value_count = drain.false_value_count;
+        first_wrong_index = drain.first_wrong_index;
+        let mut allocator = receiver_mem.allocator().lock().unwrap();
+        allocator.free(drain.ring).context(AllocationSnafu {})?;
+        allocator.free(drain.ctrl).context(AllocationSnafu {})?;
+    }
+
+    // transfers from the device: output buffer (linear mode only), statistics block, buffers of queues 1 and up
+    let stats_idx = if ring_mode { 0 } else { 1 };
+    let stats: Vec<u64> = out_vec[stats_idx].chunks_exact(size_of::<u64>())
+        .map(|w| u64::from_le_bytes(w.try_into().unwrap())).collect();
+
+    if !ring_mode && options.queues > 1 {
+        for q in 0..options.queues {
+            let data = if q == 0 { &out_vec[0] } else { &out_vec[stats_idx + q] };
+            let len = std::cmp::min(stats[STATS_QUEUE_OFFSETS + q] as usize, data.len());
+            info!("Received {} Byte in queue {}", len, q);
+            check_queue(&data[..len], &input, frame_length, options.queues, q, &mut false_value_count, &mut first_wrong_index);
+        }
+    }
+    else if !ring_mode {
+        let len = std::cmp::min((received_beat_count * 64) as usize, out_vec[0].len());
+        check_words(&out_vec[0][..len], 0, &mut false_value_count, &mut first_wrong_index);
+    }
+
+    Ok(RunResult {
+        received_beat_count,
+        wrong_header_count: (result >> 32) & 0xFFF,
+        wrong_frame_len_count: (result >> 44) & 0xFFF,
+        drop_beat_error: (result >> 56) & 0x1 != 0,
+        frame_len_error: (result >> 57) & 0x1 != 0,
+        false_value_count,
+        first_wrong_index,
+        stats,
+        transmit_cycles,
+    })
+}
+
+/// Runs with the given gap and returns the throughput if the run was lossless
+fn lossless_throughput(setup: &mut TestSetup, options: &ProgramOptions, frame_length: usize, gap_cycles: u64) -> Result<Option<f64>> {
+    let result = run(setup, options, frame_length, gap_cycles, false)?;
+    let throughput = result.throughput(options.input_size, setup.transmitter_freq);
+    let lossless = result.lossless(options.input_size);
+    info!("Frame length {} B, gap {} cycles: {:.2} Gbit/s, {}", frame_length, gap_cycles, throughput,
+        if lossless { "lossless" } else { "lossy" });
+    Ok(if lossless { Some(throughput) } else { None })
+}
+
+/// Finds the smallest lossless gap for a frame length: the gap is doubled until a run is lossless, then the
+/// range between the last lossy and the first lossless gap is bisected. Returns the gap and its throughput.
+fn search_gap(setup: &mut TestSetup, options: &ProgramOptions, frame_length: usize) -> Result<Option<(u64, f64)>> {
+    if let Some(throughput) = lossless_throughput(setup, options, frame_length, 0)? {
+        return Ok(Some((0, throughput)));
+    }
+    let mut lossy_gap = 0;
+    let mut gap = 1;
+    let (mut lossless_gap, mut best) = loop {
+        if let Some(throughput) = lossless_throughput(setup, options, frame_length, gap)? {
+            break (gap, throughput);
+        }
+        if gap == MAX_GAP_CYCLES {
+            return Ok(None);
+        }
+        lossy_gap = gap;
+        gap = std::cmp::min(gap * 2, MAX_GAP_CYCLES);
+    };
+    while lossless_gap - lossy_gap > 1 {
+        let mid = (lossy_gap + lossless_gap) / 2;
+        match lossless_throughput(setup, options, frame_length, mid)? {
+            Some(throughput) => {
+                lossless_gap = mid;
+                best = throughput;
+            }
+            None => lossy_gap = mid,
+        }
+    }
+    Ok(Some((lossless_gap, best)))
+}
+
 fn main() -> Result<()> {
     env_logger::init();
 
     let options = ProgramOptions::from_args();
 
-    if options.input_size % options.frame_length != 0 {
-        error!("Input size must be multiple of frame length");
-        return Ok(());
+    let frame_lengths = if options.search { options.search_frame_lengths.clone() } else { vec![options.frame_length] };
+    for &frame_length in &frame_lengths {
+        if frame_length == 0 || options.input_size % frame_length != 0 {
+            error!("Input size must be multiple of frame length");
+            return Ok(());
+        }
+        if frame_length % 64 != 0 || frame_length > MAX_FRAME_LENGTH {
+            error!("Frame length must be multiple of 64 and below 16 KiB");
+            return Ok(());
+        }
+        if options.flow_control && frame_length / 64 + 1 + PAUSE_SLACK_BEATS >= options.rx_buffer_depth {
+            error!("Frame length with flow control must be below {} Byte for a receive buffer of {} beats",
+                options.rx_buffer_depth.saturating_sub(1 + PAUSE_SLACK_BEATS) * 64, options.rx_buffer_depth);
+            return Ok(());
+        }
     }
     if options.input_size % 4096 != 0 {
         error!("Input size must be multiple of 4096");
         return Ok(());
     }
+    if options.ring_size % 4096 != 0 || options.ring_size > u32::MAX as usize {
+        error!("Ring size must be multiple of 4096 and below 4 GB");
+        return Ok(());
+    }
+    if options.queues == 0 || options.queues > RX_QUEUES || (options.queues > 1 && options.ring_size != 0) {
+        error!("Number of queues must be between 1 and {}, multiple queues require a linear buffer", RX_QUEUES);
+        return Ok(());
+    }
+    if options.steer_word > MAX_STEER_WORD {
+        error!("Steering word must be between 0 and {}", MAX_STEER_WORD);
+        return Ok(());
+    }
+    if options.gap_cycles > MAX_GAP_CYCLES {
+        error!("Gap must be below {} cycles", MAX_GAP_CYCLES + 1);
+        return Ok(());
+    }
 
     let tlkm = TLKM::new().context(TLKMInitSnafu {})?;
     let devices = tlkm.device_enum(&HashMap::new()).context(TLKMInitSnafu {})?;
@@ -76,6 +569,7 @@ fn main() -> Result<()> {
     let mut receiver_dev_mem = None;
     let mut transmitter_dev_mem = None;
     let mut receiver_dev_freq = 0.0;
+    let mut transmitter_dev_freq = 0.0;
 
     for mut dev in devices {
         debug!("{:?}", dev);
@@ -94,6 +588,7 @@ fn main() -> Result<()> {
                 debug!("Found EthernetTransmitter PE");
                 transmitter_pe_opt = Some(dev.acquire_pe(id).context(DeviceInitSnafu {})?);
                 transmitter_dev_mem = Some(dev.default_memory().context(DeviceInitSnafu {})?);
+                transmitter_dev_freq = dev.design_frequency_mhz().context(DeviceInitSnafu {})? as f64;
             }
         }
     }
@@ -112,8 +607,6 @@ fn main() -> Result<()> {
         error!("Error while detecting device memories.");
         return Ok(());
     }
-    let mut receiver_pe = receiver_pe_opt.unwrap();
-    let mut transmitter_pe = transmitter_pe_opt.unwrap();
 
     let input = vec![0u8; options.input_size].into_boxed_slice();
     let input_ptr = input.as_ptr() as *mut u32;
@@ -121,92 +614,35 @@ fn main() -> Result<()> {
         unsafe { *input_ptr.offset(i as isize) = i as u32; }
     }
 
-    let output = vec![0u8; OUTPUT_BUFFER_SIZE].into_boxed_slice();
-
-    let mut receiver_params = Vec::new();
-    receiver_params.push(PEParameter::DataTransferAlloc(DataTransferAlloc {
-        data: output,
-        from_device: true,
-        to_device: false,
-        free: true,
-        memory: receiver_dev_mem.unwrap(),
-        fixed: None,
-    }));
-    let mut run_cycles: u64 = (options.runtime * receiver_dev_freq * 1e6) as u64;
-    info!("Runtime: {}, Device Frequency: {}", options.runtime, receiver_dev_freq);
-    info!("Run receiver PE for {} cycles", run_cycles);
-    if run_cycles > u32::MAX as u64 {
-        warn!("Use maximum run cycles for receiver PE");
-        run_cycles = u32::MAX as u64;
+    let mut setup = TestSetup {
+        receiver_pe: receiver_pe_opt.unwrap(),
+        transmitter_pe: transmitter_pe_opt.unwrap(),
+        receiver_mem: receiver_dev_mem.unwrap(),
+        transmitter_mem: transmitter_dev_mem.unwrap(),
+        receiver_freq: receiver_dev_freq,
+        transmitter_freq: transmitter_dev_freq,
+        input,
+    };
+
+    if !options.search {
+        let result = run(&mut setup, &options, options.frame_length, options.gap_cycles, true)?;
+        result.report(options.input_size, options.frame_length);
+        info!("Throughput: {:.2} Gbit/s", result.throughput(options.input_size, setup.transmitter_freq));
+        return Ok(());
     }
-    receiver_params.push(PEParameter::Single64(run_cycles));
-    receiver_params.push(PEParameter::Single64(options.frame_length as u64));
-    receiver_params.push(PEParameter::Single64(options.src_mac));
-    receiver_params.push(PEParameter::Single64(options.dst_mac));
-    receiver_params.push(PEParameter::Single64(0xACAC));
-
-    let mut transmitter_params = Vec::new();
-    transmitter_params.push(PEParameter::DataTransferAlloc(DataTransferAlloc {
-        data: input,
-        from_device: false,
-        to_device: true,
-        free: true,
-        memory: transmitter_dev_mem.unwrap(),
-        fixed: None,
-    }));
-    transmitter_params.push(PEParameter::Single64(options.input_size as u64));
-    transmitter_params.push(PEParameter::Single64(options.frame_length as u64));
-    transmitter_params.push(PEParameter::Single64(options.gap_cycles));
-    transmitter_params.push(PEParameter::Single64(options.src_mac));
-    transmitter_params.push(PEParameter::Single64(options.dst_mac));
-    transmitter_params.push(PEParameter::Single64(0xACAC));
-
-    info!("Launch PEs");
-    receiver_pe.start(receiver_params).context(JobSnafu {})?;
-    transmitter_pe.start(transmitter_params).context(JobSnafu {})?;
 
-    let (_r, _o) = transmitter_pe.release(true, false).context(JobSnafu {})?;
-    info!("Transmitter PE released");
-    let (result, out_vec) = receiver_pe.release(true, true).context(JobSnafu {})?;
-    info!("Receiver PE released");
-
-    let received_beat_count = result & 0xFFFFFFFF;
-    let wrong_header_count = (result >> 32) & 0xFFF;
-    let wrong_frame_len_count = (result >> 44) & 0xFFF;
-    let drop_beat_error = (result >> 56) & 0x1;
-
-    if (received_beat_count) != (options.input_size as u64 / 64) {
-        error!("Received wrong number of beats ({} Byte vs. {} Byte", received_beat_count * 64, options.input_size);
-    }
-    if wrong_header_count != 0 {
-        error!("Received {} wrong headers", wrong_header_count);
+    // the PEs stay acquired between runs and are released when the setup is dropped
+    let mut table = Vec::new();
+    for &frame_length in &frame_lengths {
+        info!("Search lossless gap for frame length {} B", frame_length);
+        table.push((frame_length, search_gap(&mut setup, &options, frame_length)?));
     }
-    if wrong_frame_len_count != 0 {
-        error!("Received {} frames with wrong length", wrong_frame_len_count);
-    }
-    if drop_beat_error != 0 {
-        error!("Beats have been dropped due to backpressure from memory on receiving device...consider to increase gap_cycle parameter to reduce transmit rate");
-    }
-
-    let output_ptr = out_vec[0].as_ptr() as *mut u32;
-    let mut false_value_count = 0;
-    let mut first_wrong_index = None;
-    for i in 0..(received_beat_count * 16) {
-        unsafe {
-            if *output_ptr.offset(i as isize) != i as u32 {
-                false_value_count += 1;
-                if first_wrong_index.is_none() {
-                    first_wrong_index = Some(i);
-                }
-            }
+    println!("{:>16} {:>16} {:>20}", "Frame length [B]", "Gap [cycles]", "Throughput [Gbit/s]");
+    for (frame_length, best) in table {
+        match best {
+            Some((gap, throughput)) => println!("{:>16} {:>16} {:>20.2}", frame_length, gap, throughput),
+            None => println!("{:>16} {:>16} {:>20}", frame_length, "-", "no lossless run"),
         }
     }
-
-    if let Some(idx) = first_wrong_index {
-        error!("Encountered {} wrong values", false_value_count);
-        let frame = idx * 4 / options.frame_length as u64;
-        let beat = ((idx * 4) % options.frame_length as u64) / 64;
-        error!("First wrong value in frame {} at beat {}", frame, beat);
-    }
     Ok(())
-}
\ No newline at end of file
+}